@@ -34,6 +34,30 @@
 #include <string.h>
 #include <pwd.h>
 #include <grp.h>
+#include <time.h>
+#include <stdarg.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/fs.h> /* BLKGETSIZE64 */
+#include <sys/vfs.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/magic.h>
+#include <glob.h>
+#include <linux/hdreg.h> /* HDIO_DRIVE_CMD */
+#include <sys/fanotify.h>
+
+#ifdef WITH_PLUGINS
+#include <dlfcn.h>
+#include <link.h> /* dl_iterate_phdr */
+#endif
 
 #ifdef _GNU_SOURCE
 #include <getopt.h> /* getopt_long */
@@ -43,13 +67,38 @@
 #include <libconfig.h>
 #endif
 
+#include "pm0.h"
+#include "pm0_plugin.h"
+
 //=========== DEFINES ==========
 
 #define EXEC_NAME	"pm0"
+#ifndef PID_FILE	//pm0bench builds its own copy with a private one
 #define PID_FILE	"/var/run/pm0.pid"
+#endif
+#ifndef VM_STATE_FILE	//the writeback settings found at startup, for restoring them after a crash
+#define VM_STATE_FILE	"/run/pm0.vm"
+#endif
 #define PID_TXT_LENGTH	6
 #define DEV_FILE	"/dev/sl_pwr"
+#ifdef WITH_LIBCONFIG
 #define CONF_FILE	"/etc/pm0.conf"
+#else
+#define CONF_FILE	"/etc/pm0.kv"	//key = value lines, see read_flat_config()
+#endif
+#define DEFAULT_BACKEND	"dns313"
+#define STAGING_DIR	"/dev/shm/pm0"
+#define PROC_STATUS	"/proc/self/status"
+#define DEV_ROOT	"/dev"
+#define LOCALTIME	"/etc/localtime"
+#define STATS_FILE	"diskstats"
+#define PROC_ROOT	"/proc"
+#define SYS_ROOT	"/sys"
+
+#define MAX_DRIVES		8		//bits of a drive mask, and the bays of the largest enclosure
+#define DRIVE_COUNT		2		//the DNS-313 has two
+#define RT_STANDBY		(SIGRTMIN)	//queued by drivers of more than two drives, si_value is the drive index
+#define SIM_INTERVAL	1000	//milliseconds between simulated standby events
 
 #define IOCTL_PM0_REGISTER_PID	_IO('P',0x02)
 #define IOCTL_PM0_SET_IDLETIME	_IO('P',0x03)
@@ -72,31 +121,524 @@
 #define ERR_EXECV_FAIL				241
 #define ERR_CONFIG_READ_FAIL		240
 #define ERR_FOPEN_FAIL				239
+#define ERR_UNKNOWN_BACKEND			238
+#define ERR_TIMER_FAIL				237
+#define ERR_EXEC_INVALID			236
+#define ERR_MLOCK_FAIL				235
+#define ERR_STAGE_FAIL				234
+#define ERR_EVENT_LOOP				233
+#define ERR_CONTROL_SOCKET			232
+#define ERR_SCHEDULE				231
+#define ERR_STRICT					230
+#define ERR_HOOKS					229
+#define ERR_DRIVES					228
+#define ERR_STATS					227
+#define ERR_GROUPS					226
+#define ERR_PLUGINS					225
+
+#define SLOT_LENGTH			24		//longest rendering of a numeric placeholder for one drive
+#define CMDLINE_LOG_LENGTH	512
+#define ID_NAME_LENGTH		64		//" (name)" of a user or a group in the log
+#define COPY_BUF_LENGTH		4096
+#define ARENA_BASE			1024	//bytes of the config arena on top of what the command line and the config file need
+#define ARENA_PER_BYTE		1		//bytes of the config arena per byte of the config file
+#define ARENA_CHUNK			4096	//bytes added to the arena when a config needs more than estimated
+#define ARENA_ALIGN			8
+#define ARENA_HEAD			((sizeof(arena_t) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+#define LOG_LINE_LENGTH		256
+#define LOG_BUFFER			16384	//bytes of log lines held back while a drive sleeps
+#define STAT_BUF_LENGTH		256
+#define EV_MAX_EVENTS		8
+#define POLL_INTERVAL		5000	//milliseconds between housekeeping ticks
+#define RESUME_POLL			500		//milliseconds between two looks at a sleeping drive
+#define EVENT_HISTORY		4		//standby events remembered per drive
+#define CTL_TIMEOUT			1		//seconds a control client may take to send its command
+#define ADAPT_HISTORY		8		//policy decisions remembered for pm0ctl
+#define ADAPT_MIN_TIMEOUT	5		//minutes
+#define ADAPT_MAX_TIMEOUT	120		//minutes
+#define ADAPT_BREAKEVEN		300		//seconds of standby needed to be worth a spin-up
+#define ADAPT_IDLE_HISTORY	16		//idle periods remembered per drive for the adaptive timeout
+#define WAKE_BLOCK			4096	//bytes read to spin a drive up
+#define SCHED_PREWAKE		30		//seconds
+#define SCHED_DURATION		60		//minutes
+#define SCHED_ALL_DAYS		0x7f	//bit 0 is Sunday, as in tm_wday
+#define HOOK_STANDBY		"standby"	//event types passed to the hook as "%e"
+#define HOOK_TRIGGER		"trigger"
+#define HOOK_RESUME			"resume"
+#define HOOK_ON_STANDBY		0x1		//the events a hook is run on, standby covers trigger too
+#define HOOK_ON_RESUME		0x2
+#define HOOK_SLOTS			16		//hook processes running at once, all hooks together
+#define HOOK_MAX_RUNNING	1		//defaults of the per-hook limits
+#define HOOK_TIMEOUT		300		//seconds before a hook gets SIGTERM
+#define HOOK_KILL_AFTER		10		//seconds after SIGTERM before it gets SIGKILL
+#define MAX_PLUGINS			8
+#define PLUGIN_TIMEOUT		100		//milliseconds a plugin callback may take
+#define PLUGIN_STANDBY		1		//the callbacks called under the watchdog
+#define PLUGIN_RESUME		2
+#define PLUGIN_SHUTDOWN		3
+#define PLUGIN_TRIGGER		4
+#define IOPRIO_WHO_PROCESS	1		//the kernel's ioprio ABI, glibc has no wrapper for it
+#define IOPRIO_IDLE			(3 << 13)
+#define DENTS_LENGTH		8192	//bytes of /proc entries read at once when counting the processes of a hook
+#define METRICS_BASE		4096	//bytes of the metrics that are not per drive or per plugin, the status line of pm0ctl included
+#define METRICS_PER_DRIVE	800		//bytes of the 11 metric lines of a drive at their longest, besides its device name
+#define METRICS_PER_PLUGIN	160		//bytes of the 3 metric lines of a plugin at their longest, besides its path
+#define STATS_INTERVAL		10		//seconds between two reads of diskstats
+#define STATS_LENGTH		65536	//bytes of diskstats read, some 400 devices
+#define ATA_STANDBY_NOW		0xe0	//STANDBY IMMEDIATE, as "hdparm -y" sends it
+#define DRIVE_MOUNTS		32		//file systems mounted from the drives that are kept track of
+#define ATTR_CULPRITS		8		//processes remembered per spin-up
+#define ATTR_PATH_LENGTH	96
+#define ATTR_EVENTS			(FAN_ACCESS | FAN_MODIFY | FAN_OPEN | FAN_CLOSE_WRITE)
+#define ATTR_BUF_LENGTH		4096
+#define VM_KNOBS			5		//writeback settings under vm/ raised while a drive sleeps
+#define VM_LENGTH			32
+#define LAPTOP_EXPIRE		60000	//centiseconds dirty data may wait, as laptop-mode-tools sets it
+#define LAPTOP_WRITEBACK	60000	//centiseconds between two wakeups of the flusher threads
+#define LAPTOP_RATIO		60		//percent of memory dirty before writers are throttled
+#define LAPTOP_BG_RATIO		50		//percent of memory dirty before the flushers start
+#define LAPTOP_MODE			2		//seconds the kernel waits after a read before writing back
+#define HOT_FILES			256		//files of the hot set kept in memory
+#define MAX_STAGED			64		//files staged in resident mode, those of a reloaded configuration included
+#define FLAT_LINE_LENGTH	1024	//longest line of a key = value config file (built without libconfig)
+#define FLAT_HOOKS			16		//hooks.<n>.* of a key = value config file, n below this
+#define HOT_BUDGET			16384	//KiB
+#define HOT_REFRESH			600		//seconds between two lookups of the hot set
+#define JOURNAL_RECORDS		4096	//events kept in the journal, 40 bytes each
+
+//what a conf_t starts out as, before the command line and the config file are read
+#define CONF_DEFAULTS	{ \
+		CONF_FILE, \
+		false, \
+		0, \
+		NULL, \
+		NULL, \
+		NULL, \
+		{ SIM_INTERVAL, SIM_INTERVAL }, \
+		false, \
+		false, \
+		NULL, \
+		{ NULL }, \
+		DRIVE_COUNT, \
+		LOG_BUFFER, \
+		0, \
+		0, \
+		NULL, \
+		false, \
+		ADAPT_MIN_TIMEOUT, \
+		ADAPT_MAX_TIMEOUT, \
+		ADAPT_BREAKEVEN, \
+		NULL, \
+		0, \
+		NULL, \
+		NULL, \
+		0, \
+		NULL, \
+		STATS_INTERVAL, \
+		true, \
+		false, \
+		NULL, \
+		HOT_BUDGET, \
+		HOT_REFRESH, \
+		NULL, \
+		JOURNAL_RECORDS, \
+		NULL, \
+		NULL, \
+		NULL, \
+		0, \
+		NULL, \
+		NULL, \
+		false, \
+		{ LAPTOP_EXPIRE, LAPTOP_WRITEBACK, LAPTOP_RATIO, LAPTOP_BG_RATIO, LAPTOP_MODE }, \
+		NULL, \
+		0, \
+		NULL \
+	}
 
 //=========== TYPEDEFS ==========
 
 typedef enum { false=0, true=1 } bool;
 
+//idle: no I/O since the last tick, spinning up: a request is waiting for a drive in standby
+typedef enum drive_power { DRIVE_ACTIVE=0, DRIVE_IDLE, DRIVE_STANDBY, DRIVE_SPINUP } drive_power_t;
+
+/*
+A backend is the source of standby events and the sink of the idle timeout.
+The DNS-313 one talks to the sl_pwr kernel driver, the simulator one generates
+the very same signals in-process, so the rest of the daemon can't tell the two apart.
+*/
+typedef struct backend {
+		char const *m_name;
+		int (*m_open)(void);
+		int (*m_register_pid)(unsigned long);
+		int (*m_set_idletime)(unsigned long);
+		void (*m_event_signals)(sigset_t *);
+		int (*m_drive_of)(struct signalfd_siginfo const *);
+		void (*m_close)(void);
+} backend_t;
+
+//a scheduled workload: its drive is woken m_prewake seconds before it starts
+typedef struct window {
+		int m_drive;
+		int m_hour;
+		int m_minute;
+		unsigned int m_days;
+		unsigned long m_prewake;
+		unsigned long m_duration;
+		unsigned long m_timeout;
+		bool m_active;
+		time_t m_end;
+} window_t;
+
+//drives that wake up together (e.g. the members of a RAID1), and go to standby after m_timeout minutes
+typedef struct drive_group {
+		unsigned int m_drives;
+		unsigned long m_timeout;
+} group_t;
+
+//a command run on every standby event, with the limits it is started with
+typedef struct hook {
+		char *m_exec;
+		char **m_args;
+		unsigned int m_max_running;
+		unsigned long m_timeout;
+		unsigned long m_kill_after;
+		int m_nice;
+		bool m_idle_io;
+		unsigned long m_max_memory;
+		unsigned long m_max_procs;
+		unsigned int m_drives;
+		unsigned int m_on;
+		//set up by prepare_exec()
+		int m_fd;
+		char **m_argv;
+		struct tmpl_arg *m_tmpl;
+		char *m_strings;
+		size_t m_strings_size;
+		unsigned int m_running;
+} hook_t;
+
+//a shared object called on the events instead of a hook process, as configured
+typedef struct plugin {
+		char *m_path;
+		char *m_arg;
+		unsigned long m_timeout;
+		unsigned int m_drives;
+} plugin_t;
+
+//a block the memory of a configuration is handed out from, the newest first
+typedef struct arena {
+		struct arena *m_next;
+		size_t m_size;
+		size_t m_used;
+} arena_t;
+
 typedef struct conf {
 		char *m_conf_file;
 		bool m_verbose;
 		unsigned long m_timeout;
 		char *m_suspend_exec;
 		char **m_suspend_args;
+		backend_t const *m_backend;
+		unsigned long m_sim_interval[MAX_DRIVES];
+		bool m_resident;
+		bool m_strict;
+		char *m_staging_dir;
+		char *m_drive_dev[MAX_DRIVES];
+		int m_drive_count;
+		unsigned long m_log_buffer;
+		unsigned long m_coalesce_window;
+		unsigned long m_hook_cooldown;
+		char *m_control_socket;
+		bool m_adaptive;
+		unsigned long m_min_timeout;
+		unsigned long m_max_timeout;
+		unsigned long m_breakeven;
+		window_t *m_windows;
+		int m_window_count;
+		char *m_metrics_file;
+		hook_t *m_hooks;
+		int m_hook_count;
+		char *m_stats_root;
+		unsigned long m_stats_interval;
+		bool m_spindown;
+		bool m_attribution;
+		char **m_hot_paths;
+		unsigned long m_hot_budget;
+		unsigned long m_hot_refresh;
+		char *m_journal_file;
+		unsigned long m_journal_records;
+		char *m_resume_exec;
+		char **m_resume_args;
+		group_t *m_groups;
+		int m_group_count;
+		char *m_proc_root;
+		char *m_sys_root;
+		bool m_laptop_mode;
+		long m_vm_values[VM_KNOBS];
+		plugin_t *m_plugins;
+		int m_plugin_count;
+		arena_t *m_arena;
 } conf_t;
 
+/*
+What we know about a drive. m_io and m_io_ticks are its completed I/O count and the
+milliseconds it has spent doing I/O when it went to standby, m_tick_io its I/O count
+at the last tick. m_standby is set for the whole standby cycle, spin-up included.
+m_idle holds the last idle periods (timeout plus standby, in seconds) that ended in a
+standby, for the adaptive timeout.
+*/
+typedef struct drive {
+		char const *m_dev;
+		int m_stat_fd;
+		bool m_standby;
+		drive_power_t m_power;
+		unsigned long long m_io;
+		unsigned long long m_io_ticks;
+		unsigned long long m_tick_io;
+		unsigned long m_last_standby_ms;
+		unsigned long m_last_spinup_ms;
+		unsigned long long m_spinup_ms;
+		struct timespec m_last_hook;
+		unsigned long m_events;
+		time_t m_event_times[EVENT_HISTORY];
+		struct timespec m_standby_at;
+		struct timespec m_state_since;
+		unsigned long long m_active_ms;
+		unsigned long long m_standby_ms;
+		unsigned long m_spinups;
+		unsigned long m_hook_launches;
+		unsigned long m_hook_failures;
+		unsigned long m_hook_skips;
+		unsigned long m_hook_runs;
+		unsigned long long m_hook_ms;
+		int m_wake_fd;
+		unsigned long m_idle[ADAPT_IDLE_HISTORY];
+		unsigned long m_idle_count;
+} drive_t;
+
+//a started hook, so that it can be timed out (m_hook is NULL once a reload has replaced it), and its exit status and run time accounted to its drives
+typedef struct hook_run {
+		pid_t m_pid;
+		hook_t *m_hook;
+		unsigned long m_timeout;
+		unsigned long m_kill_after;
+		unsigned long m_max_procs;
+		unsigned int m_drives;
+		struct timespec m_started;
+		struct timespec m_deadline;
+		int m_signal;
+} hook_run_t;
+
+//a plugin as loaded at startup, m_disabled once one of its callbacks has overrun
+typedef struct loaded_plugin {
+		void *m_handle;
+		pm0_plugin_t const *m_api;
+		bool m_disabled;
+		unsigned long m_calls;
+		unsigned long long m_call_us;
+} loaded_plugin_t;
+
+//what the diskstats backend knows of a drive: m_io is its I/O count, unchanged since m_active_at
+typedef struct stats_drive {
+		bool m_seen;
+		bool m_idle;
+		unsigned long long m_io;
+		struct timespec m_active_at;
+		int m_dev_fd;
+} stats_drive_t;
+
+//a file system mounted from one of the drives, watched while that drive is in standby
+typedef struct drive_mount {
+		int m_drive;
+		int m_fd;
+		dev_t m_dev;
+} drive_mount_t;
+
+//a writeback setting of the kernel, the value it had at startup, -1 if it is left alone
+typedef struct vm_knob {
+		char const *m_name;
+		bool m_ratio;
+		int m_fd;
+		long m_normal;
+} vm_knob_t;
+
+//a process that has touched a sleeping drive, m_after seconds into its standby
+typedef struct culprit {
+		pid_t m_pid;
+		char m_comm[16];
+		char m_path[ATTR_PATH_LENGTH];
+		unsigned long m_accesses;
+		unsigned long m_after;
+} culprit_t;
+
+//the processes that touched a drive during a standby, in the order they did
+typedef struct wake_report {
+		time_t m_when;
+		unsigned long m_standby;
+		int m_count;
+		culprit_t m_culprits[ATTR_CULPRITS];
+} wake_report_t;
+
+//a file of the hot set, mapped (and locked, if m_locked) in memory
+typedef struct hot_file {
+		void *m_map;
+		size_t m_length;
+		bool m_locked;
+} hot_file_t;
+
+//one step of the adaptive timeout controller
+typedef struct decision {
+		time_t m_when;
+		int m_drive;
+		unsigned long m_gap;
+		unsigned long m_old_timeout;
+		unsigned long m_new_timeout;
+} decision_t;
+
+//anything the event loop waits on: a descriptor and what to do when it becomes readable
+typedef struct ev_source {
+		int m_fd;
+		void (*m_handler)(struct ev_source *);
+} ev_source_t;
+
+//a hook file copied to tmpfs and kept mapped, so that it stays in memory; m_path is in the arena of its configuration
+typedef struct staged {
+		char *m_path;
+		void *m_map;
+		size_t m_length;
+} staged_t;
+
+//a piece of a hook argument: literal text, or a placeholder (m_slot) filled in per event
+typedef struct tmpl_seg {
+		char m_slot;
+		char const *m_text;
+		size_t m_length;
+} tmpl_seg_t;
+
+//an argument without placeholders has no segments and is passed as it is
+typedef struct tmpl_arg {
+		tmpl_seg_t *m_segs;
+		int m_seg_count;
+} tmpl_arg_t;
+
 typedef conf_t * conf_ptr_t;
 typedef conf_t const * conf_cptr_t;
 
 //=========== GLOBALS ==========
 
-conf_t pm0_conf = {
-		CONF_FILE,
-		false,
-		0,
-		NULL,
-		NULL
-	};
+conf_t pm0_conf = CONF_DEFAULTS;
+
+int dev_fd = -1;
+timer_t sim_timers[MAX_DRIVES];
+bool sim_armed = false;
+
+int stats_fd = -1;
+char *stats_buf = NULL;
+bool stats_truncated = false;
+pid_t stats_pid = 0;
+unsigned long stats_timeout = 0;
+stats_drive_t stats_drives[MAX_DRIVES];
+
+//set by a hook's child when fexecve() fails
+volatile int exec_errno = 0;
+
+staged_t staged_files[MAX_STAGED];
+int staged_count = 0;
+//numbers the staged copies, so that a reload never overwrites one in use
+int staged_serial = 0;
+
+char const *drive_power_names[] = { "active", "idle", "standby", "spinning_up" };
+char const *default_drive_dev[MAX_DRIVES] = { "sda", "sdb", "sdc", "sdd", "sde", "sdf", "sdg", "sdh" };
+drive_t drives[MAX_DRIVES];
+drive_mount_t drive_mounts[DRIVE_MOUNTS];
+int drive_mount_count = 0;
+
+//hooks that have been started and not yet reaped
+hook_run_t hook_runs[HOOK_SLOTS];
+
+//in the order of conf_t.m_plugins, which a reload leaves as it is
+loaded_plugin_t loaded_plugins[MAX_PLUGINS];
+int loaded_count = 0;
+pm0_drive_info_t plugin_info[MAX_DRIVES];
+timer_t plugin_timer;
+bool plugin_timer_set = false;
+//0: no callback running, 1: one is, 2: it has overrun its timeout
+volatile sig_atomic_t plugin_running = 0;
+
+//the directory of the metrics file, and the names of the file and of its temporary copy in it
+int metrics_dir = -1;
+int metrics_fd = -1;
+char metrics_name[NAME_MAX+1];
+char metrics_tmp[NAME_MAX+1];
+bool metrics_dirty = false;
+//sized at startup for the drives and plugins, which only change with a restart
+char *metrics_buf = NULL;
+size_t metrics_size = 0;
+bool metrics_cut = false;
+
+decision_t decisions[ADAPT_HISTORY];
+unsigned long decision_count = 0;
+
+//drives waiting for the coalescing window to close, one bit each
+unsigned int pending_drives = 0;
+//drives seen resuming whose resume has not been acted on yet, one bit each
+unsigned int resumed_drives = 0;
+//drives seen spinning up whose groups have not been woken yet, one bit each
+unsigned int spinup_drives = 0;
+
+int epoll_fd = -1;
+ev_source_t ev_signal = { -1, NULL };
+ev_source_t ev_coalesce = { -1, NULL };
+ev_source_t ev_tick = { -1, NULL };
+ev_source_t ev_control = { -1, NULL };
+ev_source_t ev_schedule = { -1, NULL };
+ev_source_t ev_hooks = { -1, NULL };
+ev_source_t ev_stats = { -1, NULL };
+ev_source_t ev_attr = { -1, NULL };
+ev_source_t ev_hotset = { -1, NULL };
+ev_source_t ev_resume = { -1, NULL };
+
+int journal_fd = -1;
+journal_head_t *journal = NULL;
+journal_rec_t *journal_recs = NULL;
+size_t journal_length = 0;
+
+hot_file_t hot_files[HOT_FILES];
+int hot_count = 0;
+unsigned long long hot_bytes = 0;
+
+//drives whose file systems are being watched, one bit each
+unsigned int attr_armed = 0;
+//the report being collected during the current standby, and the last finished one
+wake_report_t attr_pending[MAX_DRIVES];
+wake_report_t attr_reports[MAX_DRIVES];
+
+//in the order of conf_t.m_vm_values, set while a drive sleeps
+vm_knob_t vm_knobs[VM_KNOBS] = {
+		{ "dirty_expire_centisecs", false, -1, -1 },
+		{ "dirty_writeback_centisecs", false, -1, -1 },
+		{ "dirty_ratio", true, -1, -1 },
+		{ "dirty_background_ratio", true, -1, -1 },
+		{ "laptop_mode", false, -1, -1 }
+};
+bool vm_raised = false;
+//VM_STATE_FILE holds the startup values
+bool vm_state = false;
+
+//the timeout to return to when the last scheduled window closes
+unsigned long base_timeout = 0;
+int windows_active = 0;
+
+char *log_ring = NULL;
+size_t log_ring_used = 0;
+
+//the command line, parsed again on every reload
+int saved_argc = 0;
+char **saved_argv = NULL;
+
+//the timeout as configured: a reload leaves the one in effect alone, unless this changes
+unsigned long conf_timeout = 0;
 	
 //=========== FUNCTION DECLARATIONS ==========
 
@@ -104,14 +646,177 @@ conf_t pm0_conf = {
 int init_config(config_t *, FILE *);
 int read_config(config_t *, conf_ptr_t);
 void close_config(config_t *);
+int read_schedule(config_setting_t *, conf_ptr_t);
+int read_hooks(config_setting_t *, conf_ptr_t);
+int read_args(config_setting_t *, conf_ptr_t, char const *, char ***);
+int read_drives(config_setting_t *, conf_cptr_t, unsigned int *);
+int read_events(config_setting_t *, unsigned int *);
+int read_groups(config_setting_t *, conf_ptr_t);
+int read_laptop_mode(config_t *, conf_ptr_t);
+int read_plugins(config_setting_t *, conf_ptr_t);
+#else
+int read_flat_config(FILE *, conf_ptr_t);
+int flat_main(conf_ptr_t, char const *, char *);
+int flat_hook(conf_ptr_t, hook_t *, char const *, char *);
+bool flat_split(char *, char **, char **);
+int flat_list(conf_ptr_t, char const *, char const *, char ***);
+int flat_bool(char const *, char const *, bool *);
+int flat_long(char const *, char const *, long *);
 #endif
 
 void help(FILE *, char const * const);
-bool check_exec(struct stat const *);
-void exec_suspend(int);
+void log_msg(int, char const *, ...);
+int init_log(void);
+void flush_log(void);
+void release_log(void);
+#ifdef _GNU_SOURCE
+ssize_t log_write(void *, char const *, size_t);
+#endif /* _GNU_SOURCE */
+void log_stderr(void);
+void open_drives(void);
+void close_drives(void);
+bool drive_io(int, unsigned long long *);
+bool drive_stat(int, unsigned long long *, unsigned long *, unsigned long long *);
+void drives_idle(void);
+void on_resume(ev_source_t *);
+void drive_standby(int);
+bool drives_asleep(void);
+bool drives_check(void);
+void drives_dispatch(void);
+bool drives_resumed(void);
+int open_groups(void);
+int group_of(int);
+void group_wake(int);
+char const *proc_root(void);
+char const *sys_root(void);
+int open_mounts(void);
+void close_mounts(void);
+int mount_drive_of(unsigned int, unsigned int);
+int open_laptop_mode(void);
+bool vm_state_load(void);
+bool vm_state_save(void);
+void close_laptop_mode(void);
+bool vm_read(vm_knob_t const *, long *);
+bool vm_write(vm_knob_t const *, long);
+void laptop_raise(void);
+void laptop_restore(void);
+void laptop_resumed(unsigned int);
+int open_attribution(void);
+void close_attribution(void);
+void attr_arm(int);
+void attr_disarm(int);
+void attr_record(int, struct fanotify_event_metadata const *, struct timespec const *);
+void attr_report(int, unsigned long);
+void on_attr(ev_source_t *);
+void ctl_wakeups(char *, size_t);
+int open_journal(void);
+void close_journal(void);
+void journal_write(int, unsigned int, pid_t, int, unsigned long);
+int open_hotset(void);
+void release_hotset(void);
+void hot_refresh(void);
+bool hot_add(char const *, unsigned long long);
+void on_hotset(ev_source_t *);
+int ev_init(void);
+int ev_add(ev_source_t *, int, void (*)(ev_source_t *));
+void ev_release(void);
+int ev_arm(ev_source_t *, unsigned long, unsigned long);
+bool ev_expired(ev_source_t *);
+void ev_loop(void);
+void on_signal(ev_source_t *);
+void on_coalesce(ev_source_t *);
+void on_tick(ev_source_t *);
+int open_control(void);
+void close_control(void);
+void on_control(ev_source_t *);
+void ctl_status(char *, size_t);
+void ctl_timeout(char *, size_t, char const *);
+void ctl_trigger(char *, size_t, char const *);
+void ctl_policy(char *, size_t);
+void adapt_timeout(int, unsigned long);
+void drive_wake(int);
+time_t window_start(window_t const *, time_t);
+int open_schedule(void);
+void on_schedule(ev_source_t *);
+void drive_state(int, bool, struct timespec const *);
+int open_plugins(void);
+void close_plugins(void);
+void plugins_call(unsigned int, char const *, time_t);
+bool plugin_call(int, int, pm0_event_t const *);
+void plugin_overrun(int);
+void keep_plugins(conf_ptr_t);
+#ifdef WITH_PLUGINS
+int plugin_lock(struct dl_phdr_info *, size_t, void *);
+#endif
+void hook_started(hook_t *, pid_t, unsigned int);
+void hook_failed(unsigned int);
+void hook_skipped(unsigned int);
+void count_hook_procs(void);
+void reap_children(void);
+void arm_hook_timer(void);
+void on_hook_timer(ev_source_t *);
+int open_metrics(void);
+void close_metrics(void);
+size_t render_metrics(char *, size_t);
+void write_metrics(void);
+char const *ctl_metrics(void);
+backend_t const *find_backend(char const *);
+int dns313_open(void);
+int dns313_register_pid(unsigned long);
+int dns313_set_idletime(unsigned long);
+void dns313_close(void);
+int sim_open(void);
+int sim_register_pid(unsigned long);
+int sim_set_idletime(unsigned long);
+void sim_close(void);
+int stats_open(void);
+int stats_register_pid(unsigned long);
+int stats_set_idletime(unsigned long);
+void stats_close(void);
+bool stats_read(struct timespec const *);
+void stats_spindown(int);
+void on_stats(ev_source_t *);
+void sl_pwr_event_signals(sigset_t *);
+int sl_pwr_drive_of(struct signalfd_siginfo const *);
+bool check_exec(struct stat const *, bool);
+void id_names(uid_t, gid_t, char *, char *);
+void hook_defaults(hook_t *);
+int adopt_suspend_exec(conf_ptr_t);
+int adopt_hook(conf_ptr_t, char **, char ***, unsigned int);
+int arena_init(conf_ptr_t, size_t);
+void *arena_alloc(conf_ptr_t, size_t);
+char *arena_strdup(conf_ptr_t, char const *);
+size_t arena_used(conf_cptr_t);
+void arena_release(conf_ptr_t);
+int prepare_exec(conf_ptr_t, hook_t *);
+void release_exec(hook_t *);
+int compile_args(conf_ptr_t, hook_t *);
+size_t render_slot(char, char *, size_t, unsigned int, char const *, time_t);
+void exec_suspend(unsigned int, char const *, time_t);
+void exec_hook(hook_t *, unsigned int, char const *, time_t);
+void queue_suspend(int);
+void run_suspend(char const *);
+long elapsed_ms(struct timespec const *, struct timespec const *);
+int stage_file(conf_ptr_t, char **, int);
+int stage_hooks(conf_ptr_t);
+void drop_staged(int, int);
+void unstage_hooks(void);
+unsigned long locked_bytes(void);
+int go_resident(void);
+bool on_ramfs(struct statfs const *);
+int check_strict(conf_cptr_t, int);
 int setup_default_args(conf_ptr_t);
 void cleanup_daemon();
+void cleanup_abort(void);
 void cleanup_main();
+bool stale_pid_file(void);
+void free_conf(conf_ptr_t);
+int load_conf(conf_ptr_t, int, char **);
+void reload_config(void);
+void keep_restart_only(conf_ptr_t);
+int check_drive_refs(conf_cptr_t);
+hook_t *same_hook(conf_ptr_t, hook_t const *);
+void keep_string(conf_ptr_t, char **, char **, char const *);
 void close_file(int, char*);
 void fclose_file(FILE *, char *);
 void daemon_task();
@@ -122,27 +827,25 @@ void help(FILE *fd, char const * const en) {
     fprintf( fd,
 #ifdef _GNU_SOURCE
 	     "Usage: %s -t|--timeout <min>"
-#ifdef WITH_LIBCONFIG
 		 " [-c|--config filename]"
-#endif /* WITH_LIBCONFIG */
-		 " [-h|--help] [-v|--verbose] [-x|--exec cmd [args]]\n"
+		 " [-b|--backend name] [-r|--resident] [-s|--strict] [-h|--help] [-v|--verbose] [-x|--exec cmd [args]]\n"
 	     "Options:\t-t|--timeout <minutes>:\t\tSet HDD suspend timeout.\n"
-#ifdef WITH_LIBCONFIG
 		 "\t\t-c|--config:\t\t\tUse a different config file\n"
-#endif /* WITH_LIBCONFIG */
+		 "\t\t-b|--backend:\t\t\tPower management device to use (dns313, sim or diskstats)\n"
+		 "\t\t-r|--resident:\t\t\tLock the daemon in memory and stage the hooks on tmpfs\n"
+		 "\t\t-s|--strict:\t\t\tRefuse to start unless standby events can be handled without touching any disk\n"
 		 "\t\t-h|--help:\t\t\tShow this screen\n"
 	     "\t\t-v|--verbose:\t\t\tTurn on verbose logging and output\n"
 		 "\t\t-x|--exec:\t\t\tExecute a program with arguments on suspend\n"
 #else /* not _GNU_SOURCE */ 
 	     "Usage: %s -t <minutes>"
-#ifdef WITH_LIBCONFIG
 		 " [-c filename]"
-#endif /* WITH_LIBCONFIG */		 
-		 " [-h] [-v] [-x cmd [args]]\n"
+		 " [-b name] [-r] [-s] [-h] [-v] [-x cmd [args]]\n"
 	     "Options:\t-t <minutes>:\t\tSet HDD suspend timeout.\n"
-#ifdef WITH_LIBCONFIG
 		 "\t\t-c:\t\t\tUse a different config file\n"
-#endif /* WITH_LIBCONFIG */
+		 "\t\t-b:\t\t\tPower management device to use (dns313, sim or diskstats)\n"
+		 "\t\t-r:\t\t\tLock the daemon in memory and stage the hooks on tmpfs\n"
+		 "\t\t-s:\t\t\tRefuse to start unless standby events can be handled without touching any disk\n"
 		 "\t\t-h:\t\tShow this screen\n"
 	     "\t\t-v:\t\tTurn on verbose logging and output\n"
 		 "\t\t-x:\t\t\tExecute a program with arguments on suspend\n"
@@ -153,28 +856,19 @@ void help(FILE *fd, char const * const en) {
 }
 
 
-bool check_exec(struct stat const *filestat) {
+//the names are only looked up at startup, a reload logs the numbers
+bool check_exec(struct stat const *filestat, bool names) {
 	uid_t u = getuid();
 	gid_t g = getgid();
 	
 	if (pm0_conf.m_verbose == true) {
-		struct group *grp = NULL;
-		struct passwd *pwd = NULL;
-		char *usr_str, *grp_str, *default_val = "[unknown]";
+		char usr_str[ID_NAME_LENGTH] = "", grp_str[ID_NAME_LENGTH] = "";
 		
-		if ((pwd = getpwuid(u)) == NULL) usr_str = default_val;
-		else usr_str = pwd->pw_name;
-		if ((grp = getgrgid(g)) == NULL) grp_str = default_val;
-		else grp_str = grp->gr_name;
+		if (names == true) id_names(u, g, usr_str, grp_str);
+		log_msg(LOG_INFO, "%s running with UID %d%s and GID %d%s.\n", EXEC_NAME, u, usr_str, g, grp_str);
 		
-		syslog(LOG_INFO, "%s running with UID %d (%s) and GID %d (%s).\n", EXEC_NAME, u, usr_str, g, grp_str);
-		
-		if ((pwd = getpwuid((*filestat).st_uid)) == NULL) usr_str = default_val;
-		else usr_str = pwd->pw_name;
-		if ((grp = getgrgid((*filestat).st_gid)) == NULL) grp_str = default_val;
-		else grp_str = grp->gr_name;
-		
-		syslog(LOG_INFO, "The executable is owned by UID %d (%s) and GID %d (%s).\n", filestat->st_uid, usr_str, filestat->st_gid, grp_str);		
+		if (names == true) id_names(filestat->st_uid, filestat->st_gid, usr_str, grp_str);
+		log_msg(LOG_INFO, "The executable is owned by UID %d%s and GID %d%s.\n", filestat->st_uid, usr_str, filestat->st_gid, grp_str);
 	}
 	
 	if (u == filestat->st_uid) {
@@ -192,92 +886,451 @@ bool check_exec(struct stat const *filestat) {
 	return false;
 }
 
-void exec_suspend(int n) {
+/*
+The names of a user and a group, as " (name)", for the log. The tiny build is static, and
+getpwuid() and getgrgid() would need the NSS libraries of the glibc it was linked with at
+run time, so it is made with -DNUMERIC_IDS and only logs the numbers.
+*/
+void id_names(uid_t u, gid_t g, char *usr_str, char *grp_str) {
+#ifndef NUMERIC_IDS
+	struct passwd *pwd;
+	struct group *grp;
+	
+	snprintf(usr_str, ID_NAME_LENGTH, " (%s)", ((pwd = getpwuid(u)) != NULL) ? pwd->pw_name : "[unknown]");
+	snprintf(grp_str, ID_NAME_LENGTH, " (%s)", ((grp = getgrgid(g)) != NULL) ? grp->gr_name : "[unknown]");
+#else
+	usr_str[0] = '\0';
+	grp_str[0] = '\0';
+#endif
+}
+
+/*
+Opens and checks a hook once, and compiles the argv it will be started with,
+so the per-event path needs neither stat() nor a path lookup.
+*/
+int prepare_exec(conf_ptr_t p_conf, hook_t *h) {
 	struct stat stat_buf;
-	pid_t cp;
 	int i;
 	
-	char *string_buf, *string_buf_end;
-	int sring_len;
+	//no O_CLOEXEC: a script is run by its interpreter through /dev/fd, which needs the descriptor
+	if ((h->m_fd = open(h->m_exec, O_PATH)) == -1) {
+		log_msg(LOG_ERR, "open() failed on \'%s\': %s\n", h->m_exec, strerror(errno));
+		return ERR_OPEN_FAIL;
+	}
+	
+	if (fstat(h->m_fd, &stat_buf) == -1) {
+		log_msg(LOG_ERR, "fstat() failed on \'%s\': %s\n", h->m_exec, strerror(errno));
+		release_exec(h);
+		return ERR_STAT_OTHER;
+	}
 	
-	if (stat(pm0_conf.m_suspend_exec, &stat_buf) == -1) {
-		syslog(LOG_ERR, "stat() failed on \'%s\': %s\n", pm0_conf.m_suspend_exec, strerror(errno));
-		return;
+	if ((stat_buf.st_mode & S_IFMT) != S_IFREG) {
+		log_msg(LOG_ERR, "\'%s\' is not a regular file!\n", h->m_exec);
+		release_exec(h);
+		return ERR_EXEC_INVALID;
 	}
-	else {
-		if ((stat_buf.st_mode & S_IFMT) != S_IFREG) {
-			syslog(LOG_ERR, "\'%s\' is not a regular file!\n", pm0_conf.m_suspend_exec);
-			return;
+	
+	if (check_exec(&stat_buf, p_conf == &pm0_conf) != true) {
+		log_msg(LOG_ERR, "\'%s\' is not a executable for the user/group on whose behalf %s is running on!\n", h->m_exec, EXEC_NAME);
+		release_exec(h);
+		return ERR_EXEC_INVALID;
+	}
+	
+	if ((i = compile_args(p_conf, h)) != ALL_OK) {
+		release_exec(h);
+		return i;
+	}
+	
+	return ALL_OK;
+}
+
+/*
+Splits every argument of the hook into literal text and placeholders:
+	%d	the IDs of the drives, e.g. "0,1"
+	%n	their block devices, e.g. "sda,sdb"
+	%e	the event type, "standby", "trigger" or "resume"
+	%t	the time of the event, in seconds since the Epoch
+	%s	the seconds each drive has been (or, on resume, was) in standby
+	%u	the milliseconds each drive took to spin up, on resume
+	%%	a literal '%'
+The storage the arguments are rendered into is sized for the longest possible values
+here, so exec_hook() only has to copy. All of it comes from the arena of the configuration.
+*/
+int compile_args(conf_ptr_t p_conf, hook_t *h) {
+	size_t size = 0, names = 0;
+	char const *a, *p;
+	int argc, i, n;
+	
+	for (argc=0; h->m_args[argc] != NULL; argc++);
+	for (i=0; i<pm0_conf.m_drive_count; i++) names += strlen(drives[i].m_dev) + 1;
+	
+	if (((h->m_argv = (char **) arena_alloc(p_conf, (argc+1) * sizeof(char *))) == NULL) ||
+		((h->m_tmpl = (tmpl_arg_t *) arena_alloc(p_conf, argc * sizeof(tmpl_arg_t))) == NULL)) {
+		log_msg(LOG_ERR, "arena_alloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	
+	for (i=0; i<argc; i++) {
+		a = h->m_argv[i] = h->m_args[i];
+		if (strchr(a, '%') == NULL) continue;
+		
+		//each placeholder may be followed by some text
+		for (n=1, p=a; (p = strchr(p, '%')) != NULL; p++, n+=2);
+		if ((h->m_tmpl[i].m_segs = (tmpl_seg_t *) arena_alloc(p_conf, n * sizeof(tmpl_seg_t))) == NULL) {
+			log_msg(LOG_ERR, "arena_alloc() failed!\n");
+			return ERR_OUT_OF_MEMORY;
 		}
-				
-		if (check_exec(&stat_buf) != true) {
-			syslog(LOG_ERR, "\'%s\' is not a executable for the user/group on whose behalf %s is running on!\n", pm0_conf.m_suspend_exec, EXEC_NAME);
-			return;
+		
+		n = 0;
+		while (*a != '\0') {
+			if ((a[0] == '%') && (a[1] != '\0') && (strchr("dnetsu%", a[1]) != NULL)) {
+				h->m_tmpl[i].m_segs[n++].m_slot = a[1];
+				switch (a[1]) {
+					case 'n':
+						size += names;
+						break;
+					case 'e':
+						size += strlen(HOOK_STANDBY) + strlen(HOOK_TRIGGER) + strlen(HOOK_RESUME);
+						break;
+					default:
+						size += SLOT_LENGTH * pm0_conf.m_drive_count;
+						break;
+				}
+				a += 2;
+				continue;
+			}
+			if ((a[0] == '%') && (a[1] != '\0') && (pm0_conf.m_verbose == true)) {
+				log_msg(LOG_INFO, "Unknown placeholder in \'%s\', passing it on as it is.\n", h->m_args[i]);
+			}
+			h->m_tmpl[i].m_segs[n].m_text = a;
+			p = strchr(a + 1, '%');
+			h->m_tmpl[i].m_segs[n].m_length = (p == NULL) ? strlen(a) : (size_t) (p - a);
+			size += h->m_tmpl[i].m_segs[n].m_length;
+			a += h->m_tmpl[i].m_segs[n++].m_length;
 		}
+		h->m_tmpl[i].m_seg_count = n;
+		size++;
 	}
 	
-	if ((cp = fork()) == -1) {
-		syslog(LOG_ERR, "fork() failed: %s\n", strerror(errno));
+	if ((size > 0) && ((h->m_strings = (char *) arena_alloc(p_conf, size)) == NULL)) {
+		log_msg(LOG_ERR, "arena_alloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	h->m_strings_size = size;
+	return ALL_OK;
+}
+
+//the compiled arguments stay in the arena, until the configuration is freed
+void release_exec(hook_t *h) {
+	if (h->m_fd != -1) {
+		close(h->m_fd);
+		h->m_fd = -1;
+	}
+	h->m_tmpl = NULL;
+	h->m_argv = NULL;
+	h->m_strings = NULL;
+	h->m_strings_size = 0;
+}
+
+//writes the value of a placeholder for the drives in mask, returns its length
+size_t render_slot(char slot, char *dst, size_t size, unsigned int mask, char const *event, time_t when) {
+	struct timespec now;
+	bool resume = (strcmp(event, HOOK_RESUME) == 0) ? true : false;
+	size_t len = 0;
+	int i;
+	
+	switch (slot) {
+		case 'e':
+			len = snprintf(dst, size, "%s", event);
+			break;
+		case 't':
+			len = snprintf(dst, size, "%ld", (long) when);
+			break;
+		case '%':
+			len = snprintf(dst, size, "%%");
+			break;
+		default:
+			//one value per drive, comma separated
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			for (i=0; (i<pm0_conf.m_drive_count) && (len + 1 < size); i++) {
+				if ((mask & (1u << i)) == 0) continue;
+				if (len > 0) dst[len++] = ',';
+				if (slot == 'd') len += snprintf(dst + len, size - len, "%d", i);
+				else if (slot == 'n') len += snprintf(dst + len, size - len, "%s", drives[i].m_dev);
+				else if (slot == 'u') len += snprintf(dst + len, size - len, "%lu", (resume == true) ? drives[i].m_last_spinup_ms : 0UL);
+				else if (resume == true) len += snprintf(dst + len, size - len, "%lu", drives[i].m_last_standby_ms / 1000);
+				else len += snprintf(dst + len, size - len, "%ld",
+					(drives[i].m_standby == true) ? elapsed_ms(&drives[i].m_standby_at, &now) / 1000 : 0L);
+			}
+			break;
+	}
+	return (len < size) ? len : size - 1;
+}
+
+//calls the plugins, then runs every hook of the event once, for those of the drives in mask it is bound to
+void exec_suspend(unsigned int mask, char const *event, time_t when) {
+	unsigned int on = (strcmp(event, HOOK_RESUME) == 0) ? HOOK_ON_RESUME : HOOK_ON_STANDBY;
+	int i;
+	
+	plugins_call(mask, event, when);
+	for (i=0; i<pm0_conf.m_hook_count; i++) {
+		if ((pm0_conf.m_hooks[i].m_on & on) == 0) continue;
+		if ((mask & pm0_conf.m_hooks[i].m_drives) != 0) exec_hook(&pm0_conf.m_hooks[i], mask & pm0_conf.m_hooks[i].m_drives, event, when);
+	}
+}
+
+/*
+Starts a hook with the compiled argument template filled in, unless it already runs
+m_max_running times. The child gets a process group of its own, so that it can be
+killed together with everything it has started, and its priorities and memory limit
+are set up before fexecve(). RLIMIT_NPROC would not hold the hooks of a daemon running
+as root, so m_max_procs is checked by count_hook_procs() instead. Everything it needs is prepared here, since the
+child shares our memory until fexecve(), and may only touch exec_errno.
+*/
+void exec_hook(hook_t *h, unsigned int mask, char const *event, time_t when) {
+	char cmdline[CMDLINE_LOG_LENGTH];
+	struct rlimit mem_limit;
+	sigset_t empty_set;
+	pid_t cp;
+	size_t len;
+	int i, j;
+	
+	if (h->m_running >= h->m_max_running) {
+		log_msg(LOG_WARNING, "%s is still running %u time(s), not starting it again.\n", h->m_exec, h->m_running);
+		hook_skipped(mask);
 		return;
 	}
-	if (cp == 0) {
-		for (i=0; pm0_conf.m_suspend_args[i] != NULL; i++) {
-			if (strcmp("%d", pm0_conf.m_suspend_args[i]) == 0) {
-				snprintf(pm0_conf.m_suspend_args[i], 3, "%d", n);
+	for (i=0; (i<HOOK_SLOTS) && (hook_runs[i].m_pid != 0); i++);
+	if (i == HOOK_SLOTS) {
+		log_msg(LOG_WARNING, "%d hooks are running already, not starting %s.\n", HOOK_SLOTS, h->m_exec);
+		hook_failed(mask);
+		return;
+	}
+	
+	for (i=0, len=0; h->m_argv[i] != NULL; i++) {
+		if (h->m_tmpl[i].m_seg_count == 0) continue;
+		h->m_argv[i] = h->m_strings + len;
+		for (j=0; j<h->m_tmpl[i].m_seg_count; j++) {
+			if (h->m_tmpl[i].m_segs[j].m_slot == 0) {
+				memcpy(h->m_strings + len, h->m_tmpl[i].m_segs[j].m_text, h->m_tmpl[i].m_segs[j].m_length);
+				len += h->m_tmpl[i].m_segs[j].m_length;
 			}
+			else len += render_slot(h->m_tmpl[i].m_segs[j].m_slot, h->m_strings + len, h->m_strings_size - len, mask, event, when);
 		}
-		
-		if (pm0_conf.m_verbose == true) {
-			for (i=0, sring_len=1; pm0_conf.m_suspend_args[i] != NULL; i++) {
-				sring_len += strlen(pm0_conf.m_suspend_args[i]);
-			}
-			sring_len += 3*i;//quotes(*2) and spaces
-			if ((string_buf = (char *) calloc(sring_len, sizeof(char *))) == NULL) {
-				syslog(LOG_ERR, "calloc() failed!\n");
-				cleanup_daemon();
-				exit(ERR_OUT_OF_MEMORY);
-			}
-			
-			sprintf(string_buf, "\'%s\'", pm0_conf.m_suspend_args[0]);
-			for (i=1; pm0_conf.m_suspend_args[i] != NULL; i++) {
-				string_buf_end = string_buf + strlen(string_buf);
-				sprintf(string_buf_end, " \'%s\'", pm0_conf.m_suspend_args[i]);
-			}
-				
-			//a little more extensive logging will be needed!
-			syslog(LOG_INFO, "Executing %s with arguments: %s.\n", pm0_conf.m_suspend_exec, string_buf);
-			
-			free(string_buf);
+		h->m_strings[len++] = '\0';
+	}
+	
+	if (pm0_conf.m_verbose == true) {
+		cmdline[0] = '\0';
+		for (i=0, len=0; (h->m_argv[i] != NULL) && (len < CMDLINE_LOG_LENGTH); i++) {
+			len += snprintf(cmdline + len, CMDLINE_LOG_LENGTH - len, (i == 0) ? "\'%s\'" : " \'%s\'", h->m_argv[i]);
 		}
 		
-		if (execv(pm0_conf.m_suspend_exec, pm0_conf.m_suspend_args) == -1) {
-			syslog(LOG_ERR, "execv() failed on \'%s\': %s\n", pm0_conf.m_suspend_exec, strerror(errno));
-			cleanup_daemon();
-			exit(ERR_EXECV_FAIL);
-		}
+		//a little more extensive logging will be needed!
+		log_msg(LOG_INFO, "Executing %s with arguments: %s.\n", h->m_exec, cmdline);
+	}
+	
+	mem_limit.rlim_cur = mem_limit.rlim_max = (rlim_t) h->m_max_memory * 1024;
+	sigemptyset(&empty_set);
+	exec_errno = 0;
+	
+	if ((cp = vfork()) == -1) {
+		log_msg(LOG_ERR, "vfork() failed: %s\n", strerror(errno));
+		hook_failed(mask);
+		return;
+	}
+	if (cp == 0) {
+		sigprocmask(SIG_SETMASK, &empty_set, NULL);
+		setpgid(0, 0);
+		if (h->m_nice != 0) setpriority(PRIO_PROCESS, 0, h->m_nice);
+		if (h->m_idle_io == true) syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_IDLE);
+		if (h->m_max_memory > 0) setrlimit(RLIMIT_AS, &mem_limit);
+		fexecve(h->m_fd, h->m_argv, environ);
+		exec_errno = errno;
+		_exit(ERR_EXECV_FAIL);
 	}
+	
+	if (exec_errno != 0) {
+		log_msg(LOG_ERR, "fexecve() failed on \'%s\': %s\n", h->m_exec, strerror(exec_errno));
+		hook_failed(mask);
+		return;
+	}
+	hook_started(h, cp, mask);
 }
 
 
-int setup_default_args(conf_ptr_t p_conf) {
+long elapsed_ms(struct timespec const *from, struct timespec const *to) {
+	return (to->tv_sec - from->tv_sec) * 1000 + (to->tv_nsec - from->tv_nsec) / 1000000;
+}
+
+/*
+Standby events of several drives tend to arrive within a few hundred milliseconds.
+queue_suspend() collects them for main.coalesce_window ms, so a single hook run can
+cover all of them, and drops the ones of drives whose hook ran less than
+main.hook_cooldown seconds ago, so a flapping drive can't start a storm of hooks.
+*/
+void queue_suspend(int n) {
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	if ((pm0_conf.m_hook_cooldown > 0) && ((drives[n].m_last_hook.tv_sec != 0) || (drives[n].m_last_hook.tv_nsec != 0))) {
+		if (elapsed_ms(&drives[n].m_last_hook, &now) < (long) (pm0_conf.m_hook_cooldown * 1000)) {
+			if (pm0_conf.m_verbose == true) {
+				log_msg(LOG_INFO, "HDD-%d is cooling down, not running the hook.\n", n);
+			}
+			return;
+		}
+	}
+	
+	if ((pending_drives == 0) && (pm0_conf.m_coalesce_window > 0)) {
+		ev_arm(&ev_coalesce, pm0_conf.m_coalesce_window, 0);
+	}
+	pending_drives |= (1u << n);
+	
+	if (pm0_conf.m_coalesce_window == 0) run_suspend(HOOK_STANDBY);
+}
+
+//the event time passed to the hook is that of the earliest standby event in the batch
+void run_suspend(char const *event) {
+	struct timespec now;
+	time_t when = time(NULL), t;
 	int i;
 	
-	if ((p_conf->m_suspend_args = (char **) calloc(2, sizeof(char *))) == NULL) {
-		fprintf(stderr, "calloc() failed!\n");
+	if (pending_drives == 0) return;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if ((pending_drives & (1u << i)) == 0) continue;
+		drives[i].m_last_hook = now;
+		if ((strcmp(event, HOOK_STANDBY) == 0) && (drives[i].m_events > 0)) {
+			t = drives[i].m_event_times[(drives[i].m_events - 1) % EVENT_HISTORY];
+			if (t < when) when = t;
+		}
+	}
+	exec_suspend(pending_drives, event, when);
+	pending_drives = 0;
+}
+
+int setup_default_args(conf_ptr_t p_conf) {
+	if ((p_conf->m_suspend_args = (char **) arena_alloc(p_conf, 2 * sizeof(char *))) == NULL) {
+		fprintf(stderr, "arena_alloc() failed!\n");
 		return ERR_OUT_OF_MEMORY;
 	}
 	p_conf->m_suspend_args[1] = NULL;
 			
 	//we will need to store the executable name as the 0th argument
-	i = strlen(p_conf->m_suspend_exec);
-	if ((p_conf->m_suspend_args[0] = (char *) calloc(i+1, sizeof(char))) == NULL) {
-		fprintf(stderr, "calloc() failed!\n");
+	if ((p_conf->m_suspend_args[0] = arena_strdup(p_conf, p_conf->m_suspend_exec)) == NULL) {
+		fprintf(stderr, "arena_strdup() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	return ALL_OK;
+}
+
+void hook_defaults(hook_t *h) {
+	memset(h, 0, sizeof(hook_t));
+	h->m_max_running = HOOK_MAX_RUNNING;
+	h->m_timeout = HOOK_TIMEOUT;
+	h->m_kill_after = HOOK_KILL_AFTER;
+	h->m_idle_io = true;
+	h->m_drives = ~0u;
+	h->m_on = HOOK_ON_STANDBY;
+	h->m_fd = -1;
+}
+
+//suspend_exec (from the command line or the config file) becomes the first hook, resume_exec the one after it
+int adopt_suspend_exec(conf_ptr_t p_conf) {
+	int i;
+	
+	if ((i = adopt_hook(p_conf, &p_conf->m_resume_exec, &p_conf->m_resume_args, HOOK_ON_RESUME)) != ALL_OK) return i;
+	return adopt_hook(p_conf, &p_conf->m_suspend_exec, &p_conf->m_suspend_args, HOOK_ON_STANDBY);
+}
+
+//puts a command in front of the hooks, with the default limits
+int adopt_hook(conf_ptr_t p_conf, char **exec, char ***args, unsigned int on) {
+	hook_t *tmp_hooks;
+	
+	if (*exec == NULL) return ALL_OK;
+	
+	//the old array is left in the arena, hooks are few
+	if ((tmp_hooks = (hook_t *) arena_alloc(p_conf, (p_conf->m_hook_count+1) * sizeof(hook_t))) == NULL) {
+		fprintf(stderr, "arena_alloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	if (p_conf->m_hook_count > 0) memcpy(&tmp_hooks[1], &p_conf->m_hooks[0], p_conf->m_hook_count * sizeof(hook_t));
+	p_conf->m_hooks = tmp_hooks;
+	p_conf->m_hook_count++;
+	
+	hook_defaults(&p_conf->m_hooks[0]);
+	p_conf->m_hooks[0].m_exec = *exec;
+	p_conf->m_hooks[0].m_args = *args;
+	p_conf->m_hooks[0].m_on = on;
+	*exec = NULL;
+	*args = NULL;
+	return ALL_OK;
+}
+
+/*
+Everything a configuration holds (its strings, argument lists, hooks, windows and groups,
+and the compiled argument templates) is handed out from one block, sized when it is
+loaded, and given back in one go by free_conf(). The block is sized for the command line
+and the config file; a config denser than that gets further blocks chained to it. Memory
+is zeroed as it is handed out, so the unused part of the block is never touched, and does
+not count towards the resident set.
+*/
+int arena_init(conf_ptr_t p_conf, size_t size) {
+	arena_t *a;
+	
+	if ((a = (arena_t *) malloc(ARENA_HEAD + size)) == NULL) {
+		fprintf(stderr, "malloc() failed!\n");
 		return ERR_OUT_OF_MEMORY;
 	}
-	strncpy(p_conf->m_suspend_args[0], p_conf->m_suspend_exec, i);
+	a->m_next = p_conf->m_arena;
+	a->m_size = size;
+	a->m_used = 0;
+	p_conf->m_arena = a;
 	return ALL_OK;
 }
 
+//zeroed memory from the arena of the configuration, NULL if there is no more
+void *arena_alloc(conf_ptr_t p_conf, size_t size) {
+	arena_t *a;
+	void *p;
+	
+	size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+	if ((p_conf->m_arena == NULL) || (p_conf->m_arena->m_size - p_conf->m_arena->m_used < size)) {
+		if (arena_init(p_conf, (size > ARENA_CHUNK) ? size : ARENA_CHUNK) != ALL_OK) return NULL;
+	}
+	a = p_conf->m_arena;
+	p = (char *) a + ARENA_HEAD + a->m_used;
+	a->m_used += size;
+	return memset(p, 0, size);
+}
+
+char *arena_strdup(conf_ptr_t p_conf, char const *str) {
+	char *p;
+	
+	if ((p = (char *) arena_alloc(p_conf, strlen(str)+1)) != NULL) strcpy(p, str);
+	return p;
+}
+
+size_t arena_used(conf_cptr_t p_conf) {
+	arena_t const *a;
+	size_t used = 0;
+	
+	for (a = p_conf->m_arena; a != NULL; a = a->m_next) used += a->m_used;
+	return used;
+}
+
+void arena_release(conf_ptr_t p_conf) {
+	arena_t *a;
+	
+	while ((a = p_conf->m_arena) != NULL) {
+		p_conf->m_arena = a->m_next;
+		free(a);
+	}
+}
+
 
 #ifdef WITH_LIBCONFIG
 
@@ -294,9 +1347,24 @@ int init_config(config_t *conf_main, FILE *conf_file) {
 }
 
 //	verbose = true;
+//	backend = "dns313";
+//	resident = false;
+//	strict = false;
+//	staging_dir = "/dev/shm/pm0";
+//	drives = [ "sda", "sdb" ];	(up to MAX_DRIVES, HDD-0 first)
+//	log_buffer = 16384;
+//	coalesce_window = 0;
+//	hook_cooldown = 0;
+//	control_socket = "/var/run/pm0.sock";
+//	metrics_file = "";
+//	attribution = false;
+//	journal_file = "/run/pm0.journal";
+//	journal_records = 4096;
 //	suspend_timeout = 20;
 //	suspend_exec = "/bin/bash";
 //	suspend_args = [];
+//	resume_exec = "/bin/sh";
+//	resume_args = [];
 int read_config(config_t *source, conf_ptr_t target) {
 	config_setting_t *tmp_setting;
 	char const *tmp_s;
@@ -310,158 +1378,4082 @@ int read_config(config_t *source, conf_ptr_t target) {
 		fprintf(stderr, "Now parsing config file.\n");
 	}
 	
-	if (config_lookup_int(source, "main.suspend_timeout", &tmp_i) == CONFIG_TRUE) {
-			if ((target->m_timeout == 0) && (tmp_i > 0)) target->m_timeout = (unsigned long) tmp_i;
+	if (config_lookup_string(source, "main.backend", &tmp_s) == CONFIG_TRUE) {
+		if (target->m_backend == NULL) {
+			if ((target->m_backend = find_backend(tmp_s)) == NULL) {
+				fprintf(stderr, "Unknown backend \'%s\' in the config file!\n", tmp_s);
+				return ERR_UNKNOWN_BACKEND;
+			}
+		}
 	}
-	else {
-		if (target->m_verbose == true) {
-			fprintf(stderr, "No setting named \'main.suspend_timeout\' was found in the config file.\n");
-		}	
+	
+	if (config_lookup_bool(source, "main.resident", &tmp_i) == CONFIG_TRUE) {
+		if ((target->m_resident == false) && (tmp_i == true)) target->m_resident = true;
 	}
-	if (config_lookup_string(source, "main.suspend_exec", &tmp_s) == CONFIG_TRUE) {
-		//no exec was set on command line AND the config file contains something more than ""
-		if ((target->m_suspend_exec == NULL) && (strlen(tmp_s) > 0)) {
-			i=strlen(tmp_s);
-			if ((target->m_suspend_exec = (char *) calloc(i+1, sizeof(char))) == NULL) {
-				fprintf(stderr, "calloc() failed!\n");
+	
+	if (config_lookup_bool(source, "main.strict", &tmp_i) == CONFIG_TRUE) {
+		if ((target->m_strict == false) && (tmp_i == true)) target->m_strict = true;
+	}
+	
+	if (config_lookup_string(source, "main.staging_dir", &tmp_s) == CONFIG_TRUE) {
+		if ((target->m_staging_dir == NULL) && (strlen(tmp_s) > 0)) {
+			if ((target->m_staging_dir = arena_strdup(target, tmp_s)) == NULL) {
+				fprintf(stderr, "arena_strdup() failed!\n");
 				return ERR_OUT_OF_MEMORY;
 			}
-			strncpy(target->m_suspend_exec, tmp_s, i);
-			
-			
-			if ((tmp_setting = config_lookup(source, "main.suspend_args")) != NULL) {
-				if ((config_setting_type(tmp_setting) == CONFIG_TYPE_ARRAY) || (config_setting_type(tmp_setting) == CONFIG_TYPE_LIST)) {
-					tmp_i = config_setting_length(tmp_setting);
-					if (target->m_verbose == true) {
-						fprintf(stderr, "The argument list in the config file has %d elements.\n", tmp_i);
-					}
-					
-					if ((target->m_suspend_args = (char **) calloc(tmp_i+2, sizeof(char *))) == NULL) {
-						fprintf(stderr, "calloc() failed!\n");
-						return ERR_OUT_OF_MEMORY;
-					}
-					
-					tmp_s = target->m_suspend_exec;
-					i = 0;
-					
-					do {
-						j = strlen(tmp_s);
-						if ((target->m_suspend_args[i] = (char *) calloc(j+1, sizeof(char))) == NULL) {
-							fprintf(stderr, "calloc() failed!\n");
-							return ERR_OUT_OF_MEMORY;
-						}
-						strncpy(target->m_suspend_args[i], tmp_s, j);
-					
-						if ((i<tmp_i) && ((tmp_s = config_setting_get_string_elem(tmp_setting, i)) == NULL)) {
-							fprintf(stderr, "Element %d in the argument list is not a STRING!\n", i+1);
-							if (target->m_verbose == true) {
-								fprintf(stderr, "Discarding any further arguments.\n");
-							}
-							i++;//we have to set up 'i' to set the last entry after the last known good one to be NULL
-							break;
-						}
-					} while ((i++)<tmp_i);
-					target->m_suspend_args[i] = NULL;
-							
+		}
+	}
+	
+	if ((tmp_setting = config_lookup(source, "main.drives")) != NULL) {
+		if ((config_setting_type(tmp_setting) == CONFIG_TYPE_ARRAY) || (config_setting_type(tmp_setting) == CONFIG_TYPE_LIST)) {
+			if (config_setting_length(tmp_setting) > MAX_DRIVES) {
+				fprintf(stderr, "main.drives lists more than %d drives, ignoring the rest.\n", MAX_DRIVES);
+			}
+			//the drive IDs are the indexes in the list, so it can't have holes
+			for (i=0; (i < config_setting_length(tmp_setting)) && (i < MAX_DRIVES); i++) {
+				if ((tmp_s = config_setting_get_string_elem(tmp_setting, i)) == NULL) {
+					fprintf(stderr, "Element %d in main.drives is not a STRING!\n", i+1);
+					return ERR_DRIVES;
 				}
-				else {
-					fprintf(stderr, "The setting main.suspend_args is not of type ARRAY or LIST!\n");
-					if (target->m_suspend_args == NULL) {
-						if (target->m_verbose == true) {
-							fprintf(stderr, "No valid argument list found, reverting to a default empty one.\n");
-						}
-						if ((i = setup_default_args(target)) != ALL_OK) return i;
-					}
+				if ((target->m_drive_dev[i] = arena_strdup(target, tmp_s)) == NULL) {
+					fprintf(stderr, "arena_strdup() failed!\n");
+					return ERR_OUT_OF_MEMORY;
 				}
 			}
-			else {
+			if (i > 0) target->m_drive_count = i;
+		}
+		else {
+			fprintf(stderr, "The setting main.drives is not of type ARRAY or LIST!\n");
+		}
+	}
+	
+	if (config_lookup_bool(source, "main.attribution", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i == true) target->m_attribution = true;
+	}
+	
+	if (config_lookup_string(source, "main.proc_root", &tmp_s) == CONFIG_TRUE) {
+		if ((target->m_proc_root = arena_strdup(target, tmp_s)) == NULL) {
+			fprintf(stderr, "arena_strdup() failed!\n");
+			return ERR_OUT_OF_MEMORY;
+		}
+	}
+	
+	if (config_lookup_string(source, "main.sys_root", &tmp_s) == CONFIG_TRUE) {
+		if ((target->m_sys_root = arena_strdup(target, tmp_s)) == NULL) {
+			fprintf(stderr, "arena_strdup() failed!\n");
+			return ERR_OUT_OF_MEMORY;
+		}
+	}
+	
+	if (config_lookup_int(source, "main.log_buffer", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i >= 0) target->m_log_buffer = (unsigned long) tmp_i;
+	}
+	
+	if (config_lookup_int(source, "main.coalesce_window", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i >= 0) target->m_coalesce_window = (unsigned long) tmp_i;
+	}
+	
+	if (config_lookup_int(source, "main.hook_cooldown", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i >= 0) target->m_hook_cooldown = (unsigned long) tmp_i;
+	}
+	
+	if (config_lookup_string(source, "main.control_socket", &tmp_s) == CONFIG_TRUE) {
+		if (target->m_control_socket == NULL) {
+			if ((target->m_control_socket = arena_strdup(target, tmp_s)) == NULL) {
+				fprintf(stderr, "arena_strdup() failed!\n");
+				return ERR_OUT_OF_MEMORY;
+			}
+		}
+	}
+	
+	if (config_lookup_string(source, "main.resume_exec", &tmp_s) == CONFIG_TRUE) {
+		if ((target->m_resume_exec == NULL) && (strlen(tmp_s) > 0)) {
+			if ((target->m_resume_exec = arena_strdup(target, tmp_s)) == NULL) {
+				fprintf(stderr, "arena_strdup() failed!\n");
+				return ERR_OUT_OF_MEMORY;
+			}
+			if ((i = read_args(config_lookup(source, "main.resume_args"), target, target->m_resume_exec, &target->m_resume_args)) != ALL_OK) return i;
+		}
+	}
+	
+	if (config_lookup_string(source, "main.journal_file", &tmp_s) == CONFIG_TRUE) {
+		if (target->m_journal_file == NULL) {
+			if ((target->m_journal_file = arena_strdup(target, tmp_s)) == NULL) {
+				fprintf(stderr, "arena_strdup() failed!\n");
+				return ERR_OUT_OF_MEMORY;
+			}
+		}
+	}
+	
+	if (config_lookup_int(source, "main.journal_records", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i >= 0) target->m_journal_records = (unsigned long) tmp_i;
+	}
+	
+	if (config_lookup_bool(source, "adaptive.enabled", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i == true) target->m_adaptive = true;
+	}
+	if (config_lookup_int(source, "adaptive.min_timeout", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i > 0) target->m_min_timeout = (unsigned long) tmp_i;
+	}
+	if (config_lookup_int(source, "adaptive.max_timeout", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i > 0) target->m_max_timeout = (unsigned long) tmp_i;
+	}
+	if (config_lookup_int(source, "adaptive.breakeven", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i >= 0) target->m_breakeven = (unsigned long) tmp_i;
+	}
+	if (target->m_min_timeout > target->m_max_timeout) {
+		fprintf(stderr, "adaptive.min_timeout is larger than adaptive.max_timeout!\n");
+		return ERR_INVALID_ARG;
+	}
+	
+	if (config_lookup_string(source, "main.metrics_file", &tmp_s) == CONFIG_TRUE) {
+		if ((target->m_metrics_file == NULL) && (strlen(tmp_s) > 0)) {
+			if ((target->m_metrics_file = arena_strdup(target, tmp_s)) == NULL) {
+				fprintf(stderr, "arena_strdup() failed!\n");
+				return ERR_OUT_OF_MEMORY;
+			}
+		}
+	}
+	
+	if ((tmp_setting = config_lookup(source, "hotset.paths")) != NULL) {
+		if ((config_setting_type(tmp_setting) == CONFIG_TYPE_ARRAY) || (config_setting_type(tmp_setting) == CONFIG_TYPE_LIST)) {
+			j = config_setting_length(tmp_setting);
+			if ((j > 0) && ((target->m_hot_paths = (char **) arena_alloc(target, (j+1) * sizeof(char *))) == NULL)) {
+				fprintf(stderr, "arena_alloc() failed!\n");
+				return ERR_OUT_OF_MEMORY;
+			}
+			for (i=0; i<j; i++) {
+				if ((tmp_s = config_setting_get_string_elem(tmp_setting, i)) == NULL) {
+					fprintf(stderr, "Element %d in hotset.paths is not a STRING!\n", i+1);
+					return ERR_INVALID_ARG;
+				}
+				if ((target->m_hot_paths[i] = arena_strdup(target, tmp_s)) == NULL) {
+					fprintf(stderr, "arena_strdup() failed!\n");
+					return ERR_OUT_OF_MEMORY;
+				}
+			}
+		}
+		else {
+			fprintf(stderr, "The setting hotset.paths is not of type ARRAY or LIST!\n");
+		}
+	}
+	if (config_lookup_int(source, "hotset.budget", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i >= 0) target->m_hot_budget = (unsigned long) tmp_i;
+	}
+	if (config_lookup_int(source, "hotset.refresh", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i > 0) target->m_hot_refresh = (unsigned long) tmp_i;
+	}
+	
+	if ((tmp_setting = config_lookup(source, "schedule")) != NULL) {
+		if ((i = read_schedule(tmp_setting, target)) != ALL_OK) return i;
+	}
+	
+	if ((tmp_setting = config_lookup(source, "hooks")) != NULL) {
+		if ((i = read_hooks(tmp_setting, target)) != ALL_OK) return i;
+	}
+	
+	if ((tmp_setting = config_lookup(source, "groups")) != NULL) {
+		if ((i = read_groups(tmp_setting, target)) != ALL_OK) return i;
+	}
+	
+	if ((tmp_setting = config_lookup(source, "plugins")) != NULL) {
+		if ((i = read_plugins(tmp_setting, target)) != ALL_OK) return i;
+	}
+	
+	if ((i = read_laptop_mode(source, target)) != ALL_OK) return i;
+	
+	if ((tmp_setting = config_lookup(source, "simulator.interval")) != NULL) {
+		if ((config_setting_type(tmp_setting) == CONFIG_TYPE_ARRAY) || (config_setting_type(tmp_setting) == CONFIG_TYPE_LIST)) {
+			for (i=0; (i < config_setting_length(tmp_setting)) && (i < MAX_DRIVES); i++) {
+				if ((tmp_i = config_setting_get_int_elem(tmp_setting, i)) >= 0) target->m_sim_interval[i] = (unsigned long) tmp_i;
+			}
+		}
+		else {
+			fprintf(stderr, "The setting simulator.interval is not of type ARRAY or LIST!\n");
+		}
+	}
+	
+	//	diskstats: { root = "/proc"; interval = 10; spindown = true; };
+	if (config_lookup_string(source, "diskstats.root", &tmp_s) == CONFIG_TRUE) {
+		if ((target->m_stats_root = arena_strdup(target, tmp_s)) == NULL) {
+			fprintf(stderr, "arena_strdup() failed!\n");
+			return ERR_OUT_OF_MEMORY;
+		}
+	}
+	if ((config_lookup_int(source, "diskstats.interval", &tmp_i) == CONFIG_TRUE) && (tmp_i > 0)) {
+		target->m_stats_interval = (unsigned long) tmp_i;
+	}
+	if (config_lookup_bool(source, "diskstats.spindown", &tmp_i) == CONFIG_TRUE) {
+		target->m_spindown = (tmp_i == true) ? true : false;
+	}
+	
+	if (config_lookup_int(source, "main.suspend_timeout", &tmp_i) == CONFIG_TRUE) {
+			if ((target->m_timeout == 0) && (tmp_i > 0)) target->m_timeout = (unsigned long) tmp_i;
+	}
+	else {
+		if (target->m_verbose == true) {
+			fprintf(stderr, "No setting named \'main.suspend_timeout\' was found in the config file.\n");
+		}	
+	}
+	if (config_lookup_string(source, "main.suspend_exec", &tmp_s) == CONFIG_TRUE) {
+		//no exec was set on command line AND the config file contains something more than ""
+		if ((target->m_suspend_exec == NULL) && (strlen(tmp_s) > 0)) {
+			if ((target->m_suspend_exec = arena_strdup(target, tmp_s)) == NULL) {
+				fprintf(stderr, "arena_strdup() failed!\n");
+				return ERR_OUT_OF_MEMORY;
+			}
+			
+			
+			if ((tmp_setting = config_lookup(source, "main.suspend_args")) != NULL) {
+				if ((config_setting_type(tmp_setting) == CONFIG_TYPE_ARRAY) || (config_setting_type(tmp_setting) == CONFIG_TYPE_LIST)) {
+					tmp_i = config_setting_length(tmp_setting);
+					if (target->m_verbose == true) {
+						fprintf(stderr, "The argument list in the config file has %d elements.\n", tmp_i);
+					}
+					
+					if ((target->m_suspend_args = (char **) arena_alloc(target, (tmp_i+2) * sizeof(char *))) == NULL) {
+						fprintf(stderr, "arena_alloc() failed!\n");
+						return ERR_OUT_OF_MEMORY;
+					}
+					
+					tmp_s = target->m_suspend_exec;
+					i = 0;
+					
+					do {
+						if ((target->m_suspend_args[i] = arena_strdup(target, tmp_s)) == NULL) {
+							fprintf(stderr, "arena_strdup() failed!\n");
+							return ERR_OUT_OF_MEMORY;
+						}
+					
+						if ((i<tmp_i) && ((tmp_s = config_setting_get_string_elem(tmp_setting, i)) == NULL)) {
+							fprintf(stderr, "Element %d in the argument list is not a STRING!\n", i+1);
+							if (target->m_verbose == true) {
+								fprintf(stderr, "Discarding any further arguments.\n");
+							}
+							i++;//we have to set up 'i' to set the last entry after the last known good one to be NULL
+							break;
+						}
+					} while ((i++)<tmp_i);
+					target->m_suspend_args[i] = NULL;
+							
+				}
+				else {
+					fprintf(stderr, "The setting main.suspend_args is not of type ARRAY or LIST!\n");
+					if (target->m_suspend_args == NULL) {
+						if (target->m_verbose == true) {
+							fprintf(stderr, "No valid argument list found, reverting to a default empty one.\n");
+						}
+						if ((i = setup_default_args(target)) != ALL_OK) return i;
+					}
+				}
+			}
+			else {
 				if (target->m_verbose == true) {
 					fprintf(stderr, "No setting named \'main.suspend_args\' was found in the config file.\n");
 				}
+				if (target->m_suspend_args == NULL) {
+					if ((i = setup_default_args(target)) != ALL_OK) return i;
+				}
+			}
+		}
+	}
+	else {
+		if (target->m_verbose == true) {
+			fprintf(stderr, "No setting named \'main.suspend_exec\' was found in the config file.\n");
+		}	
+	}
+	
+	return ALL_OK;
+}
+
+void close_config(config_t *conf_main) {
+	config_destroy(conf_main);
+}
+
+//	hooks = ( { exec = "/bin/sh"; args = [ "/root/sync.sh", "%d" ]; max_running = 1; timeout = 300; kill_after = 10;
+//		nice = 10; idle_io = true; max_memory = 16384; max_processes = 32; } );
+int read_hooks(config_setting_t *list, conf_ptr_t target) {
+	config_setting_t *entry;
+	hook_t *h, *tmp_hooks;
+	char const *tmp_s;
+	int tmp_i, i, n, ret;
+	
+	if ((config_setting_type(list) != CONFIG_TYPE_LIST) && (config_setting_type(list) != CONFIG_TYPE_ARRAY)) {
+		fprintf(stderr, "The setting hooks is not of type LIST!\n");
+		return ERR_HOOKS;
+	}
+	
+	if ((n = config_setting_length(list)) == 0) return ALL_OK;
+	if ((tmp_hooks = (hook_t *) arena_alloc(target, (target->m_hook_count+n) * sizeof(hook_t))) == NULL) {
+		fprintf(stderr, "arena_alloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	if (target->m_hook_count > 0) memcpy(tmp_hooks, target->m_hooks, target->m_hook_count * sizeof(hook_t));
+	target->m_hooks = tmp_hooks;
+	
+	for (i=0; i<n; i++) {
+		entry = config_setting_get_elem(list, i);
+		h = &target->m_hooks[target->m_hook_count];
+		hook_defaults(h);
+		
+		if ((config_setting_lookup_string(entry, "exec", &tmp_s) != CONFIG_TRUE) || (strlen(tmp_s) == 0)) {
+			fprintf(stderr, "Hook %d has no 'exec', ignoring it.\n", i+1);
+			continue;
+		}
+		if ((h->m_exec = arena_strdup(target, tmp_s)) == NULL) {
+			fprintf(stderr, "arena_strdup() failed!\n");
+			return ERR_OUT_OF_MEMORY;
+		}
+		//from here on the hook is released with the others
+		target->m_hook_count++;
+		
+		if ((ret = read_args(config_setting_get_member(entry, "args"), target, h->m_exec, &h->m_args)) != ALL_OK) return ret;
+		
+		if ((config_setting_lookup_int(entry, "max_running", &tmp_i) == CONFIG_TRUE) && (tmp_i > 0)) h->m_max_running = tmp_i;
+		if ((config_setting_lookup_int(entry, "timeout", &tmp_i) == CONFIG_TRUE) && (tmp_i >= 0)) h->m_timeout = tmp_i;
+		if ((config_setting_lookup_int(entry, "kill_after", &tmp_i) == CONFIG_TRUE) && (tmp_i > 0)) h->m_kill_after = tmp_i;
+		if ((config_setting_lookup_int(entry, "nice", &tmp_i) == CONFIG_TRUE) && (tmp_i >= -20) && (tmp_i <= 19)) h->m_nice = tmp_i;
+		if (config_setting_lookup_bool(entry, "idle_io", &tmp_i) == CONFIG_TRUE) h->m_idle_io = (tmp_i == true) ? true : false;
+		if ((config_setting_lookup_int(entry, "max_memory", &tmp_i) == CONFIG_TRUE) && (tmp_i >= 0)) h->m_max_memory = tmp_i;
+		if ((config_setting_lookup_int(entry, "max_processes", &tmp_i) == CONFIG_TRUE) && (tmp_i >= 0)) h->m_max_procs = tmp_i;
+		if ((ret = read_drives(config_setting_get_member(entry, "drives"), target, &h->m_drives)) != ALL_OK) return ret;
+		if ((ret = read_events(config_setting_get_member(entry, "on"), &h->m_on)) != ALL_OK) return ret;
+		
+		if (target->m_verbose == true) {
+			fprintf(stderr, "Hook %d: '%s', at most %u running, timeout %lu s.\n", i+1, h->m_exec, h->m_max_running, h->m_timeout);
+		}
+	}
+	return ALL_OK;
+}
+
+//	on = [ "standby", "resume" ];	(default: standby, a single string will do too)
+int read_events(config_setting_t *list, unsigned int *mask) {
+	char const *tmp_s;
+	int i, n = 1;
+	
+	if (list == NULL) return ALL_OK;
+	if ((config_setting_type(list) == CONFIG_TYPE_ARRAY) || (config_setting_type(list) == CONFIG_TYPE_LIST)) n = config_setting_length(list);
+	
+	*mask = 0;
+	for (i=0; i<n; i++) {
+		tmp_s = (config_setting_type(list) == CONFIG_TYPE_STRING) ? config_setting_get_string(list) : config_setting_get_string_elem(list, i);
+		if ((tmp_s != NULL) && (strcmp(tmp_s, HOOK_STANDBY) == 0)) *mask |= HOOK_ON_STANDBY;
+		else if ((tmp_s != NULL) && (strcmp(tmp_s, HOOK_RESUME) == 0)) *mask |= HOOK_ON_RESUME;
+		else {
+			fprintf(stderr, "A hook can only be run on \"%s\" and \"%s\" events!\n", HOOK_STANDBY, HOOK_RESUME);
+			return ERR_HOOKS;
+		}
+	}
+	return ALL_OK;
+}
+
+//	drives = [ 0, 2 ];	(default: all of them)
+int read_drives(config_setting_t *list, conf_cptr_t target, unsigned int *mask) {
+	int i, n;
+	
+	if (list == NULL) return ALL_OK;
+	if ((config_setting_type(list) != CONFIG_TYPE_ARRAY) && (config_setting_type(list) != CONFIG_TYPE_LIST)) {
+		fprintf(stderr, "The drives of a hook are not of type ARRAY or LIST!\n");
+		return ERR_HOOKS;
+	}
+	
+	for (*mask = 0, i=0; i<config_setting_length(list); i++) {
+		n = config_setting_get_int_elem(list, i);
+		if ((n < 0) || (n >= target->m_drive_count)) {
+			fprintf(stderr, "There is no HDD-%d to run a hook for!\n", n);
+			return ERR_HOOKS;
+		}
+		*mask |= (1u << n);
+	}
+	return ALL_OK;
+}
+
+//the argument list of a hook, with the executable as the 0th argument
+int read_args(config_setting_t *list, conf_ptr_t target, char const *exec, char ***args) {
+	char const *tmp_s;
+	int i, n = 0;
+	
+	if (list != NULL) {
+		if ((config_setting_type(list) != CONFIG_TYPE_ARRAY) && (config_setting_type(list) != CONFIG_TYPE_LIST)) {
+			fprintf(stderr, "The arguments of '%s' are not of type ARRAY or LIST!\n", exec);
+			return ERR_HOOKS;
+		}
+		n = config_setting_length(list);
+	}
+	
+	if ((*args = (char **) arena_alloc(target, (n+2) * sizeof(char *))) == NULL) {
+		fprintf(stderr, "arena_alloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	for (i=0; i<=n; i++) {
+		if (i == 0) tmp_s = exec;
+		else if ((tmp_s = config_setting_get_string_elem(list, i-1)) == NULL) {
+			fprintf(stderr, "Element %d in the arguments of '%s' is not a STRING!\n", i, exec);
+			return ERR_HOOKS;
+		}
+		if (((*args)[i] = arena_strdup(target, tmp_s)) == NULL) {
+			fprintf(stderr, "arena_strdup() failed!\n");
+			return ERR_OUT_OF_MEMORY;
+		}
+	}
+	return ALL_OK;
+}
+
+#else //WITH_LIBCONFIG
+
+/*
+Without libconfig, the config file holds "key = value" lines, the keys being the paths
+libconfig would use: "main.suspend_timeout = 20", "hooks.0.exec = /bin/sh". The items of
+a list (drives, args, on) are separated by blanks, and nothing is quoted, so an argument
+can't contain a blank. A '#' starts a comment. Only main.* and hooks.<n>.* are read, any
+other key is an error, so that a file written for libconfig is not half-read silently.
+*/
+int read_flat_config(FILE *source, conf_ptr_t target) {
+	char line[FLAT_LINE_LENGTH];
+	char *hook_args[FLAT_HOOKS] = { NULL };
+	char *suspend_exec = NULL, *suspend_args = NULL, *resume_exec = NULL, *resume_args = NULL;
+	char **raw;
+	char *key, *value;
+	hook_t *tmp_hooks, *h;
+	unsigned int all;
+	int hooks = 0, base = target->m_hook_count, line_no = 0, n, skip, i, j;
+	
+	//the hooks are counted first, to be handed out from the arena in one go
+	while (fgets(line, FLAT_LINE_LENGTH, source) != NULL) {
+		if ((flat_split(line, &key, &value) == true) && (sscanf(key, "hooks.%d.", &n) == 1) && (n >= hooks) && (n < FLAT_HOOKS)) hooks = n + 1;
+	}
+	if (hooks > 0) {
+		if ((tmp_hooks = (hook_t *) arena_alloc(target, (base + hooks) * sizeof(hook_t))) == NULL) {
+			fprintf(stderr, "arena_alloc() failed!\n");
+			return ERR_OUT_OF_MEMORY;
+		}
+		if (base > 0) memcpy(tmp_hooks, target->m_hooks, base * sizeof(hook_t));
+		for (i=0; i<hooks; i++) hook_defaults(&tmp_hooks[base + i]);
+		target->m_hooks = tmp_hooks;
+	}
+	rewind(source);
+	
+	while (fgets(line, FLAT_LINE_LENGTH, source) != NULL) {
+		line_no++;
+		if ((strchr(line, '\n') == NULL) && (feof(source) == 0)) {
+			fprintf(stderr, "Line %d of '%s' is longer than %d characters!\n", line_no, target->m_conf_file, FLAT_LINE_LENGTH - 2);
+			return ERR_CONFIG_READ_FAIL;
+		}
+		if (flat_split(line, &key, &value) == false) {
+			if (key == NULL) continue;
+			fprintf(stderr, "Line %d of '%s' is not a \"key = value\" setting!\n", line_no, target->m_conf_file);
+			return ERR_CONFIG_READ_FAIL;
+		}
+		
+		//the executables are only known at the end, their arguments are kept until then
+		raw = NULL;
+		skip = 0;
+		if (strcmp(key, "main.suspend_exec") == 0) raw = &suspend_exec;
+		else if (strcmp(key, "main.suspend_args") == 0) raw = &suspend_args;
+		else if (strcmp(key, "main.resume_exec") == 0) raw = &resume_exec;
+		else if (strcmp(key, "main.resume_args") == 0) raw = &resume_args;
+		else if ((sscanf(key, "hooks.%d.%n", &n, &skip) == 1) && (skip > 0) && (n >= 0) && (n < FLAT_HOOKS) &&
+			(strcmp(key + skip, "args") == 0)) raw = &hook_args[n];
+		if (raw != NULL) {
+			if ((*raw = arena_strdup(target, value)) == NULL) {
+				fprintf(stderr, "arena_strdup() failed!\n");
+				return ERR_OUT_OF_MEMORY;
+			}
+			continue;
+		}
+		
+		if (strncmp(key, "main.", 5) == 0) i = flat_main(target, key + 5, value);
+		else if ((skip > 0) && (n >= 0) && (n < FLAT_HOOKS)) i = flat_hook(target, &target->m_hooks[base + n], key + skip, value);
+		else {
+			fprintf(stderr, "Unknown setting '%s'", key);
+			i = ERR_CONFIG_READ_FAIL;
+		}
+		if (i != ALL_OK) {
+			fprintf(stderr, " (line %d of '%s')\n", line_no, target->m_conf_file);
+			return i;
+		}
+	}
+	
+	if ((suspend_exec != NULL) && (target->m_suspend_exec == NULL) && (strlen(suspend_exec) > 0)) {
+		target->m_suspend_exec = suspend_exec;
+		if ((i = flat_list(target, suspend_args, suspend_exec, &target->m_suspend_args)) < 0) return ERR_OUT_OF_MEMORY;
+	}
+	if ((resume_exec != NULL) && (target->m_resume_exec == NULL) && (strlen(resume_exec) > 0)) {
+		target->m_resume_exec = resume_exec;
+		if ((i = flat_list(target, resume_args, resume_exec, &target->m_resume_args)) < 0) return ERR_OUT_OF_MEMORY;
+	}
+	
+	//main.drives may come after the hooks, so their drives are only checked now
+	all = (1u << target->m_drive_count) - 1;
+	for (i=0, j=base; i<hooks; i++) {
+		h = &target->m_hooks[base + i];
+		if (h->m_exec == NULL) {
+			if (hook_args[i] != NULL) fprintf(stderr, "Hook %d has no 'exec', ignoring it.\n", i);
+			continue;
+		}
+		if ((h->m_drives != ~0u) && ((h->m_drives & ~all) != 0)) {
+			fprintf(stderr, "hooks.%d.drives names a drive beyond the %d in main.drives!\n", i, target->m_drive_count);
+			return ERR_HOOKS;
+		}
+		if (flat_list(target, hook_args[i], h->m_exec, &h->m_args) < 0) return ERR_OUT_OF_MEMORY;
+		if (target->m_verbose == true) {
+			fprintf(stderr, "Hook %d: '%s', at most %u running, timeout %lu s.\n", i, h->m_exec, h->m_max_running, h->m_timeout);
+		}
+		target->m_hooks[j++] = *h;
+	}
+	target->m_hook_count = j;
+	return ALL_OK;
+}
+
+//the part of the key after "main."; the command line wins, as with libconfig
+int flat_main(conf_ptr_t target, char const *key, char *value) {
+	char **drives;
+	bool tmp_b;
+	long tmp_l;
+	int i, ret;
+	
+	if ((strcmp(key, "verbose") == 0) || (strcmp(key, "resident") == 0) || (strcmp(key, "strict") == 0) || (strcmp(key, "attribution") == 0)) {
+		if ((ret = flat_bool(key, value, &tmp_b)) != ALL_OK) return ret;
+		if (tmp_b == false) return ALL_OK;
+		if (key[0] == 'v') target->m_verbose = true;
+		else if (key[0] == 'r') target->m_resident = true;
+		else if (key[0] == 's') target->m_strict = true;
+		else target->m_attribution = true;
+	}
+	else if (strcmp(key, "backend") == 0) {
+		if ((target->m_backend == NULL) && ((target->m_backend = find_backend(value)) == NULL)) {
+			fprintf(stderr, "Unknown backend '%s'", value);
+			return ERR_UNKNOWN_BACKEND;
+		}
+	}
+	else if (strcmp(key, "drives") == 0) {
+		if ((i = flat_list(target, value, NULL, &drives)) < 0) return ERR_OUT_OF_MEMORY;
+		if (i > MAX_DRIVES) fprintf(stderr, "main.drives lists more than %d drives, ignoring the rest.\n", MAX_DRIVES);
+		for (i=0; (drives[i] != NULL) && (i < MAX_DRIVES); i++) target->m_drive_dev[i] = drives[i];
+		if (i > 0) target->m_drive_count = i;
+	}
+	else if ((strcmp(key, "log_buffer") == 0) || (strcmp(key, "coalesce_window") == 0) || (strcmp(key, "hook_cooldown") == 0) ||
+		(strcmp(key, "journal_records") == 0) || (strcmp(key, "suspend_timeout") == 0)) {
+		if ((ret = flat_long(key, value, &tmp_l)) != ALL_OK) return ret;
+		if (tmp_l < 0) return ALL_OK;
+		if (key[0] == 'l') target->m_log_buffer = (unsigned long) tmp_l;
+		else if (key[0] == 'c') target->m_coalesce_window = (unsigned long) tmp_l;
+		else if (key[0] == 'h') target->m_hook_cooldown = (unsigned long) tmp_l;
+		else if (key[0] == 'j') target->m_journal_records = (unsigned long) tmp_l;
+		else if ((target->m_timeout == 0) && (tmp_l > 0)) target->m_timeout = (unsigned long) tmp_l;
+	}
+	else if ((strcmp(key, "staging_dir") == 0) && (target->m_staging_dir == NULL) && (strlen(value) > 0)) {
+		if ((target->m_staging_dir = arena_strdup(target, value)) == NULL) return ERR_OUT_OF_MEMORY;
+	}
+	else if ((strcmp(key, "control_socket") == 0) && (target->m_control_socket == NULL)) {
+		if ((target->m_control_socket = arena_strdup(target, value)) == NULL) return ERR_OUT_OF_MEMORY;
+	}
+	else if ((strcmp(key, "journal_file") == 0) && (target->m_journal_file == NULL)) {
+		if ((target->m_journal_file = arena_strdup(target, value)) == NULL) return ERR_OUT_OF_MEMORY;
+	}
+	else if ((strcmp(key, "metrics_file") == 0) && (target->m_metrics_file == NULL) && (strlen(value) > 0)) {
+		if ((target->m_metrics_file = arena_strdup(target, value)) == NULL) return ERR_OUT_OF_MEMORY;
+	}
+	else if (strcmp(key, "proc_root") == 0) {
+		if ((target->m_proc_root = arena_strdup(target, value)) == NULL) return ERR_OUT_OF_MEMORY;
+	}
+	else if (strcmp(key, "sys_root") == 0) {
+		if ((target->m_sys_root = arena_strdup(target, value)) == NULL) return ERR_OUT_OF_MEMORY;
+	}
+	else if ((strcmp(key, "staging_dir") != 0) && (strcmp(key, "control_socket") != 0) &&
+		(strcmp(key, "journal_file") != 0) && (strcmp(key, "metrics_file") != 0)) {
+		fprintf(stderr, "Unknown setting 'main.%s'", key);
+		return ERR_CONFIG_READ_FAIL;
+	}
+	return ALL_OK;
+}
+
+//the part of the key after "hooks.<n>.", args are handled by the caller
+int flat_hook(conf_ptr_t target, hook_t *h, char const *key, char *value) {
+	char *item, *save;
+	bool tmp_b;
+	long tmp_l;
+	int ret;
+	
+	if (strcmp(key, "exec") == 0) {
+		if ((strlen(value) > 0) && ((h->m_exec = arena_strdup(target, value)) == NULL)) return ERR_OUT_OF_MEMORY;
+	}
+	else if (strcmp(key, "idle_io") == 0) {
+		if ((ret = flat_bool(key, value, &tmp_b)) != ALL_OK) return ret;
+		h->m_idle_io = tmp_b;
+	}
+	else if (strcmp(key, "drives") == 0) {
+		for (h->m_drives = 0, item = strtok_r(value, " \t", &save); item != NULL; item = strtok_r(NULL, " \t", &save)) {
+			if ((ret = flat_long(key, item, &tmp_l)) != ALL_OK) return ret;
+			if ((tmp_l < 0) || (tmp_l >= MAX_DRIVES)) {
+				fprintf(stderr, "There is no HDD-%ld to run a hook for!", tmp_l);
+				return ERR_HOOKS;
+			}
+			h->m_drives |= (1u << tmp_l);
+		}
+	}
+	else if (strcmp(key, "on") == 0) {
+		for (h->m_on = 0, item = strtok_r(value, " \t", &save); item != NULL; item = strtok_r(NULL, " \t", &save)) {
+			if (strcmp(item, HOOK_STANDBY) == 0) h->m_on |= HOOK_ON_STANDBY;
+			else if (strcmp(item, HOOK_RESUME) == 0) h->m_on |= HOOK_ON_RESUME;
+			else {
+				fprintf(stderr, "A hook can only be run on \"%s\" and \"%s\" events!", HOOK_STANDBY, HOOK_RESUME);
+				return ERR_HOOKS;
 			}
 		}
 	}
-	else {
-		if (target->m_verbose == true) {
-			fprintf(stderr, "No setting named \'main.suspend_exec\' was found in the config file.\n");
-		}	
+	else if ((strcmp(key, "max_running") == 0) || (strcmp(key, "timeout") == 0) || (strcmp(key, "kill_after") == 0) ||
+		(strcmp(key, "nice") == 0) || (strcmp(key, "max_memory") == 0) || (strcmp(key, "max_processes") == 0)) {
+		if ((ret = flat_long(key, value, &tmp_l)) != ALL_OK) return ret;
+		if ((strcmp(key, "max_running") == 0) && (tmp_l > 0)) h->m_max_running = tmp_l;
+		else if ((strcmp(key, "timeout") == 0) && (tmp_l >= 0)) h->m_timeout = tmp_l;
+		else if ((strcmp(key, "kill_after") == 0) && (tmp_l > 0)) h->m_kill_after = tmp_l;
+		else if ((strcmp(key, "nice") == 0) && (tmp_l >= -20) && (tmp_l <= 19)) h->m_nice = tmp_l;
+		else if ((strcmp(key, "max_memory") == 0) && (tmp_l >= 0)) h->m_max_memory = tmp_l;
+		else if ((strcmp(key, "max_processes") == 0) && (tmp_l >= 0)) h->m_max_procs = tmp_l;
+	}
+	else {
+		fprintf(stderr, "Unknown hook setting '%s'", key);
+		return ERR_CONFIG_READ_FAIL;
+	}
+	return ALL_OK;
+}
+
+//cuts the comment and the blanks off a line, false if what is left is not "key = value" (*key is NULL if nothing is)
+bool flat_split(char *line, char **key, char **value) {
+	char *eq, *end;
+	
+	line[strcspn(line, "#\r\n")] = '\0';
+	line += strspn(line, " \t");
+	*key = (*line != '\0') ? line : NULL;
+	*value = NULL;
+	if ((*key == NULL) || ((eq = strchr(line, '=')) == NULL)) return false;
+	
+	for (end = eq; (end > line) && ((end[-1] == ' ') || (end[-1] == '\t')); end--);
+	*end = '\0';
+	*value = eq + 1 + strspn(eq + 1, " \t");
+	for (end = *value + strlen(*value); (end > *value) && ((end[-1] == ' ') || (end[-1] == '\t')); end--);
+	*end = '\0';
+	return (strlen(*key) > 0) ? true : false;
+}
+
+//the blank separated items of value in a NULL terminated array, after first if that is given; the count, -1 if out of memory
+int flat_list(conf_ptr_t target, char const *value, char const *first, char ***list) {
+	char const *p = (value != NULL) ? value : "";
+	int n = (first != NULL) ? 1 : 0, i = 0;
+	size_t len;
+	
+	for (p += strspn(p, " \t"); *p != '\0'; p += strspn(p, " \t"), n++) p += strcspn(p, " \t");
+	if ((*list = (char **) arena_alloc(target, (n+1) * sizeof(char *))) == NULL) {
+		fprintf(stderr, "arena_alloc() failed!\n");
+		return -1;
+	}
+	if ((first != NULL) && (((*list)[i++] = arena_strdup(target, first)) == NULL)) return -1;
+	for (p = (value != NULL) ? value : "", p += strspn(p, " \t"); *p != '\0'; p += strspn(p, " \t")) {
+		len = strcspn(p, " \t");
+		if (((*list)[i] = (char *) arena_alloc(target, len + 1)) == NULL) return -1;
+		memcpy((*list)[i++], p, len);
+		p += len;
+	}
+	return n;
+}
+
+int flat_bool(char const *key, char const *value, bool *b) {
+	if ((strcasecmp(value, "true") == 0) || (strcasecmp(value, "yes") == 0) || (strcmp(value, "1") == 0)) *b = true;
+	else if ((strcasecmp(value, "false") == 0) || (strcasecmp(value, "no") == 0) || (strcmp(value, "0") == 0)) *b = false;
+	else {
+		fprintf(stderr, "The setting %s is not true or false", key);
+		return ERR_INVALID_ARG;
+	}
+	return ALL_OK;
+}
+
+int flat_long(char const *key, char const *value, long *l) {
+	char *end;
+	
+	*l = strtol(value, &end, 10);
+	if ((end == value) || (*end != '\0')) {
+		fprintf(stderr, "The setting %s is not a number", key);
+		return ERR_INVALID_ARG;
+	}
+	return ALL_OK;
+}
+
+#endif //WITH_LIBCONFIG
+ 
+void cleanup_daemon() {
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Cleaning up after daemon_task().\n");
+	}
+	
+	if (pm0_conf.m_backend != NULL) pm0_conf.m_backend->m_close();
+	close_plugins();
+	unstage_hooks();
+	close_metrics();
+	close_journal();
+	close_laptop_mode();
+	close_attribution();
+	close_mounts();
+	release_hotset();
+	if (remove(PID_FILE) != 0) {
+		log_msg(LOG_ERR, "remove() failed on \'%s\': %s\n", PID_FILE, strerror(errno));
+	}
+	close_control();
+	ev_release();
+	close_drives();
+	free_conf(&pm0_conf);
+	release_log();
+	closelog();
+}
+
+/*
+The files cleanup_daemon() would remove, for a daemon that is about to abort() from a
+signal handler: unlink() and rmdir() are async-signal-safe, the rest of it is not.
+*/
+void cleanup_abort(void) {
+	int i;
+	
+	for (i=0; i<staged_count; i++) unlink(staged_files[i].m_path);
+	if (staged_count > 0) rmdir((pm0_conf.m_staging_dir != NULL) ? pm0_conf.m_staging_dir : STAGING_DIR);
+	if (ev_control.m_fd != -1) unlink((pm0_conf.m_control_socket != NULL) ? pm0_conf.m_control_socket : CTL_SOCKET);
+	unlink(PID_FILE);
+}
+
+void cleanup_main() {
+	if (pm0_conf.m_verbose == true) {
+		fprintf(stderr, "Cleaning up after main().\n");
+	}
+	
+	free_conf(&pm0_conf);
+}
+
+//a PID file left by a daemon that was killed, its PID belongs to no process any more
+bool stale_pid_file(void) {
+	char pid_buf[32] = {0};
+	long pid;
+	int fd;
+	
+	if ((fd = open(PID_FILE, O_RDONLY | O_CLOEXEC)) == -1) return false;
+	if (read(fd, pid_buf, sizeof(pid_buf) - 1) <= 0) {
+		close(fd);
+		return false;
+	}
+	close(fd);
+	if ((sscanf(pid_buf, "%ld", &pid) != 1) || (pid <= 0)) return false;
+	if ((kill((pid_t) pid, 0) == 0) || (errno != ESRCH)) return false;
+	
+	fprintf(stderr, "Removing '%s', left behind by PID %ld, which is no longer running.\n", PID_FILE, pid);
+	return (unlink(PID_FILE) == 0) ? true : false;
+}
+
+//gives back everything load_conf() has allocated for a configuration
+void free_conf(conf_ptr_t p_conf) {
+	int i;
+	
+	for (i=0; i<p_conf->m_hook_count; i++) release_exec(&p_conf->m_hooks[i]);
+	arena_release(p_conf);
+	
+	p_conf->m_suspend_exec = NULL;
+	p_conf->m_suspend_args = NULL;
+	p_conf->m_resume_exec = NULL;
+	p_conf->m_resume_args = NULL;
+	p_conf->m_hooks = NULL;
+	p_conf->m_hook_count = 0;
+	p_conf->m_staging_dir = NULL;
+	p_conf->m_control_socket = NULL;
+	p_conf->m_metrics_file = NULL;
+	p_conf->m_journal_file = NULL;
+	p_conf->m_stats_root = NULL;
+	p_conf->m_proc_root = NULL;
+	p_conf->m_sys_root = NULL;
+	p_conf->m_hot_paths = NULL;
+	p_conf->m_windows = NULL;
+	p_conf->m_window_count = 0;
+	p_conf->m_groups = NULL;
+	p_conf->m_group_count = 0;
+	p_conf->m_plugins = NULL;
+	p_conf->m_plugin_count = 0;
+	for (i=0; i<MAX_DRIVES; i++) p_conf->m_drive_dev[i] = NULL;
+}
+
+
+void close_file(int fd, char *str) {
+		if (close(fd) == -1) {
+				log_msg(LOG_ERR, "close() failed on \'%s\': %s\n", str, strerror(errno));
+				cleanup_daemon();
+		}
+}
+
+void fclose_file(FILE *file, char *str) {
+		if (fclose(file) == -1) {
+				fprintf(stderr, "fclose() failed on \'%s\': %s", str, strerror(errno));
+		}
+}
+
+//=========== HOOKS ==========
+
+void hook_started(hook_t *h, pid_t pid, unsigned int mask) {
+	int i;
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if ((mask & (1u << i)) != 0) drives[i].m_hook_launches++;
+	}
+	metrics_dirty = true;
+	
+	//exec_hook() has made sure that there is a free slot
+	for (i=0; (i<HOOK_SLOTS) && (hook_runs[i].m_pid != 0); i++);
+	
+	//the child has called setpgid() itself, vfork() only returns once it has exec'd or exited
+	hook_runs[i].m_pid = pid;
+	hook_runs[i].m_hook = h;
+	hook_runs[i].m_timeout = h->m_timeout;
+	hook_runs[i].m_kill_after = h->m_kill_after;
+	hook_runs[i].m_max_procs = h->m_max_procs;
+	hook_runs[i].m_drives = mask;
+	hook_runs[i].m_signal = 0;
+	clock_gettime(CLOCK_MONOTONIC, &hook_runs[i].m_started);
+	hook_runs[i].m_deadline = hook_runs[i].m_started;
+	hook_runs[i].m_deadline.tv_sec += h->m_timeout;
+	h->m_running++;
+	if (h->m_timeout > 0) arm_hook_timer();
+	journal_write(JOURNAL_HOOK_START, mask, pid, 0, 0);
+}
+
+void hook_failed(unsigned int mask) {
+	int i;
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if ((mask & (1u << i)) != 0) {
+			drives[i].m_hook_launches++;
+			drives[i].m_hook_failures++;
+		}
+	}
+	metrics_dirty = true;
+	journal_write(JOURNAL_HOOK_FAIL, mask, 0, 0, 0);
+}
+
+//a hook not started because it was still running m_max_running times
+void hook_skipped(unsigned int mask) {
+	int i;
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if ((mask & (1u << i)) != 0) drives[i].m_hook_skips++;
+	}
+	metrics_dirty = true;
+}
+
+/*
+Counts the processes in the group of each running hook that has a process limit, and
+kills the whole group of one that is over it. This runs on the housekeeping tick, so a
+hook can go over its limit for a few seconds, and a process that leaves the group (by
+setsid(), for one) is not counted. /proc is read with getdents64() into a buffer on the
+stack, as opendir() would allocate.
+*/
+void count_hook_procs(void) {
+	char dents[DENTS_LENGTH], path[PATH_MAX], stat_buf[512];
+	unsigned long procs[HOOK_SLOTS];
+	struct { uint64_t d_ino; int64_t d_off; unsigned short d_reclen; unsigned char d_type; char d_name[1]; } *d;
+	char *p;
+	long n, off;
+	ssize_t len;
+	int dir_fd, fd, pgrp, i;
+	bool limited = false;
+	
+	for (i=0; i<HOOK_SLOTS; i++) {
+		procs[i] = 0;
+		if ((hook_runs[i].m_pid != 0) && (hook_runs[i].m_max_procs > 0) && (hook_runs[i].m_signal != SIGKILL)) limited = true;
+	}
+	if (limited == false) return;
+	
+	if ((dir_fd = open(proc_root(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) return;
+	while ((n = syscall(SYS_getdents64, dir_fd, dents, DENTS_LENGTH)) > 0) {
+		for (off=0; off<n; off += d->d_reclen) {
+			d = (void *) (dents + off);
+			if ((d->d_name[0] < '1') || (d->d_name[0] > '9')) continue;
+			
+			snprintf(path, PATH_MAX, "%s/%s/stat", proc_root(), d->d_name);
+			if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) continue;
+			len = read(fd, stat_buf, sizeof(stat_buf) - 1);
+			close(fd);
+			if (len <= 0) continue;
+			stat_buf[len] = '\0';
+			
+			//the name in brackets may hold anything, the fields after it are "state ppid pgrp"
+			if (((p = strrchr(stat_buf, ')')) == NULL) || (sscanf(p + 1, " %*c %*d %d", &pgrp) != 1)) continue;
+			for (i=0; i<HOOK_SLOTS; i++) {
+				if ((hook_runs[i].m_pid == pgrp) && (hook_runs[i].m_max_procs > 0)) procs[i]++;
+			}
+		}
+	}
+	close(dir_fd);
+	
+	for (i=0; i<HOOK_SLOTS; i++) {
+		if ((hook_runs[i].m_pid == 0) || (hook_runs[i].m_max_procs == 0) || (hook_runs[i].m_signal == SIGKILL)) continue;
+		if (procs[i] <= hook_runs[i].m_max_procs) continue;
+		
+		log_msg(LOG_WARNING, "%s (PID %ld) runs %lu processes, over its limit of %lu, sending it SIGKILL.\n",
+			(hook_runs[i].m_hook != NULL) ? hook_runs[i].m_hook->m_exec : "A hook", (long) hook_runs[i].m_pid, procs[i], hook_runs[i].m_max_procs);
+		hook_runs[i].m_signal = SIGKILL;
+		if (kill(-hook_runs[i].m_pid, SIGKILL) == -1) kill(hook_runs[i].m_pid, SIGKILL);
+	}
+}
+
+//reaps every finished child, and books the run time and outcome of the hooks among them
+void reap_children(void) {
+	struct timespec now;
+	unsigned long ms;
+	pid_t pid;
+	int status, i, j;
+	
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		for (i=0; (i<HOOK_SLOTS) && (hook_runs[i].m_pid != pid); i++);
+		if (i == HOOK_SLOTS) continue;
+		
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		ms = elapsed_ms(&hook_runs[i].m_started, &now);
+		for (j=0; j<pm0_conf.m_drive_count; j++) {
+			if ((hook_runs[i].m_drives & (1u << j)) == 0) continue;
+			drives[j].m_hook_runs++;
+			drives[j].m_hook_ms += ms;
+			if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) drives[j].m_hook_failures++;
+		}
+		
+		journal_write(JOURNAL_HOOK_EXIT, hook_runs[i].m_drives, pid, WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status), ms);
+		
+		//whatever a timed out hook has left behind goes with it
+		if (hook_runs[i].m_signal != 0) kill(-pid, SIGKILL);
+		
+		if (hook_runs[i].m_hook != NULL) hook_runs[i].m_hook->m_running--;
+		hook_runs[i].m_pid = 0;
+		metrics_dirty = true;
+	}
+}
+
+//arms the timer for the nearest deadline of the running hooks, or disarms it
+void arm_hook_timer(void) {
+	struct timespec now;
+	long ms, next = -1;
+	int i;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i=0; i<HOOK_SLOTS; i++) {
+		if ((hook_runs[i].m_pid == 0) || (hook_runs[i].m_timeout == 0) || (hook_runs[i].m_signal == SIGKILL)) continue;
+		if ((ms = elapsed_ms(&now, &hook_runs[i].m_deadline)) < 1) ms = 1;
+		if ((next == -1) || (ms < next)) next = ms;
+	}
+	ev_arm(&ev_hooks, (next == -1) ? 0 : (unsigned long) next, 0);
+}
+
+/*
+A hook that is still running at its deadline gets SIGTERM, along with its whole
+process group, and SIGKILL m_kill_after seconds later if that did not help.
+*/
+void on_hook_timer(ev_source_t *src) {
+	struct timespec now;
+	hook_run_t *r;
+	int i;
+	
+	ev_expired(src);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	for (i=0; i<HOOK_SLOTS; i++) {
+		r = &hook_runs[i];
+		if ((r->m_pid == 0) || (r->m_timeout == 0) || (r->m_signal == SIGKILL)) continue;
+		if (elapsed_ms(&now, &r->m_deadline) > 0) continue;
+		
+		r->m_signal = (r->m_signal == 0) ? SIGTERM : SIGKILL;
+		log_msg(LOG_WARNING, "%s (PID %ld) has run for %ld s, sending it %s.\n", (r->m_hook != NULL) ? r->m_hook->m_exec : "A hook", (long) r->m_pid,
+			elapsed_ms(&r->m_started, &now) / 1000, (r->m_signal == SIGTERM) ? "SIGTERM" : "SIGKILL");
+		if (kill(-r->m_pid, r->m_signal) == -1) kill(r->m_pid, r->m_signal);
+		r->m_deadline = now;
+		r->m_deadline.tv_sec += r->m_kill_after;
+	}
+	arm_hook_timer();
+}
+
+//=========== PLUGINS ==========
+
+/*
+A plugin is called from the event loop in place of a hook process, so lighting an LED
+or sending a notification costs a function call instead of a vfork() and an exec. The
+shared objects are loaded at startup with RTLD_NOW, so that no symbol is looked up later,
+and their segments are locked in memory (resident mode locks everything anyway). Each
+callback runs under a watchdog: a POSIX timer, armed for the timeout of the plugin. A
+callback that overruns it is let finish, and the plugin is not called again after that.
+The interface itself is in pm0_plugin.h.
+*/
+#ifdef WITH_LIBCONFIG
+
+//	plugins = ( { path = "/usr/local/lib/pm0/pm0led.so"; arg = "/sys/class/leds/hdd/brightness"; timeout = 100; drives = [ 0 ]; } );
+int read_plugins(config_setting_t *list, conf_ptr_t target) {
+	config_setting_t *entry;
+	char const *tmp_s;
+	plugin_t *p;
+	int tmp_i, i, n, ret;
+	
+	if ((config_setting_type(list) != CONFIG_TYPE_LIST) && (config_setting_type(list) != CONFIG_TYPE_ARRAY)) {
+		fprintf(stderr, "The setting plugins is not of type LIST!\n");
+		return ERR_PLUGINS;
+	}
+	
+	if ((n = config_setting_length(list)) == 0) return ALL_OK;
+	if (n > MAX_PLUGINS) {
+		fprintf(stderr, "More than %d plugins are listed!\n", MAX_PLUGINS);
+		return ERR_PLUGINS;
+	}
+	if ((target->m_plugins = (plugin_t *) arena_alloc(target, n * sizeof(plugin_t))) == NULL) {
+		fprintf(stderr, "arena_alloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	
+	for (i=0; i<n; i++) {
+		entry = config_setting_get_elem(list, i);
+		p = &target->m_plugins[i];
+		
+		if ((config_setting_lookup_string(entry, "path", &tmp_s) != CONFIG_TRUE) || (strlen(tmp_s) == 0)) {
+			fprintf(stderr, "Plugin %d has no 'path'!\n", i+1);
+			return ERR_PLUGINS;
+		}
+		if ((p->m_path = arena_strdup(target, tmp_s)) == NULL) {
+			fprintf(stderr, "arena_strdup() failed!\n");
+			return ERR_OUT_OF_MEMORY;
+		}
+		if (config_setting_lookup_string(entry, "arg", &tmp_s) != CONFIG_TRUE) tmp_s = "";
+		if ((p->m_arg = arena_strdup(target, tmp_s)) == NULL) {
+			fprintf(stderr, "arena_strdup() failed!\n");
+			return ERR_OUT_OF_MEMORY;
+		}
+		p->m_timeout = PLUGIN_TIMEOUT;
+		if ((config_setting_lookup_int(entry, "timeout", &tmp_i) == CONFIG_TRUE) && (tmp_i >= 0)) p->m_timeout = tmp_i;
+		p->m_drives = ~0u;
+		if ((ret = read_drives(config_setting_get_member(entry, "drives"), target, &p->m_drives)) != ALL_OK) return ret;
+		target->m_plugin_count++;
+		
+		if (target->m_verbose == true) {
+			fprintf(stderr, "Plugin %d: '%s', timeout %lu ms.\n", i+1, p->m_path, p->m_timeout);
+		}
+	}
+	
+#ifndef WITH_PLUGINS
+	fprintf(stderr, "This pm0 has been built without WITH_PLUGINS, it can't load plugins!\n");
+	return ERR_PLUGINS;
+#endif
+	return ALL_OK;
+}
+
+#endif //WITH_LIBCONFIG
+
+#ifdef WITH_PLUGINS
+
+int open_plugins(void) {
+	struct sigaction sa;
+	struct sigevent sev;
+	struct link_map *lm;
+	plugin_t const *p;
+	loaded_plugin_t *l;
+	int i;
+	
+	if (pm0_conf.m_plugin_count == 0) return ALL_OK;
+	
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = plugin_overrun;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGALRM, &sa, NULL) == -1) {
+		log_msg(LOG_ERR, "sigaction() failed: %s\n", strerror(errno));
+		return ERR_SIGACTION_FAIL;
+	}
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_SIGNAL;
+	sev.sigev_signo = SIGALRM;
+	if (timer_create(CLOCK_MONOTONIC, &sev, &plugin_timer) == -1) {
+		log_msg(LOG_ERR, "timer_create() failed: %s\n", strerror(errno));
+		return ERR_TIMER_FAIL;
+	}
+	plugin_timer_set = true;
+	
+	for (i=0; i<pm0_conf.m_plugin_count; i++) {
+		p = &pm0_conf.m_plugins[i];
+		l = &loaded_plugins[i];
+		
+		if ((l->m_handle = dlopen(p->m_path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+			log_msg(LOG_ERR, "dlopen() failed: %s\n", dlerror());
+			return ERR_PLUGINS;
+		}
+		loaded_count++;
+		
+		l->m_api = (pm0_plugin_t const *) dlsym(l->m_handle, PM0_PLUGIN_SYMBOL);
+		if ((l->m_api == NULL) || (l->m_api->m_abi != PM0_PLUGIN_ABI) || (l->m_api->m_name == NULL)) {
+			log_msg(LOG_ERR, "\'%s\' is not a plugin of this version of pm0!\n", p->m_path);
+			l->m_api = NULL;
+			return ERR_PLUGINS;
+		}
+		if ((pm0_conf.m_resident == false) && (dlinfo(l->m_handle, RTLD_DI_LINKMAP, &lm) == 0)) dl_iterate_phdr(plugin_lock, lm);
+		
+		//a plugin that has not started is not shut down either
+		if ((l->m_api->m_init != NULL) && (l->m_api->m_init(p->m_arg) != 0)) {
+			log_msg(LOG_ERR, "Plugin %s has failed to start with \'%s\'.\n", l->m_api->m_name, p->m_arg);
+			l->m_api = NULL;
+			return ERR_PLUGINS;
+		}
+		if (pm0_conf.m_verbose == true) {
+			log_msg(LOG_INFO, "Plugin %s loaded from \'%s\', its callbacks may take %lu ms.\n", l->m_api->m_name, p->m_path, p->m_timeout);
+		}
+	}
+	return ALL_OK;
+}
+
+//one that has overrun did return in the end, so it is still shut down
+void close_plugins(void) {
+	int i;
+	
+	for (i=0; i<loaded_count; i++) {
+		if (loaded_plugins[i].m_api == NULL) continue;
+		if (loaded_plugins[i].m_api->m_shutdown != NULL) plugin_call(i, PLUGIN_SHUTDOWN, NULL);
+		dlclose(loaded_plugins[i].m_handle);
+		loaded_plugins[i].m_api = NULL;
+		loaded_plugins[i].m_disabled = false;
+	}
+	loaded_count = 0;
+	if (plugin_timer_set == true) {
+		timer_delete(plugin_timer);
+		plugin_timer_set = false;
+	}
+}
+
+//the segments of the plugin just loaded, told apart from the other objects by their load address
+int plugin_lock(struct dl_phdr_info *info, size_t size, void *data) {
+	struct link_map const *lm = (struct link_map const *) data;
+	uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE), start, end;
+	int i;
+	
+	if (info->dlpi_addr != lm->l_addr) return 0;
+	for (i=0; i<info->dlpi_phnum; i++) {
+		if (info->dlpi_phdr[i].p_type != PT_LOAD) continue;
+		start = info->dlpi_addr + info->dlpi_phdr[i].p_vaddr;
+		end = start + info->dlpi_phdr[i].p_memsz;
+		start &= ~(page - 1);
+		if (mlock((void *) start, end - start) == -1) {
+			log_msg(LOG_WARNING, "mlock() failed on \'%s\': %s\n", lm->l_name, strerror(errno));
+			break;
+		}
+	}
+	return 1;
+}
+
+//calls the plugins bound to any of the drives in mask, with what the hooks get as placeholders
+void plugins_call(unsigned int mask, char const *event, time_t when) {
+	bool resume = (strcmp(event, HOOK_RESUME) == 0) ? true : false;
+	struct timespec now;
+	pm0_event_t ev;
+	int i, which;
+	
+	if (loaded_count == 0) return;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		plugin_info[i].m_dev = drives[i].m_dev;
+		if (resume == true) plugin_info[i].m_standby_ms = drives[i].m_last_standby_ms;
+		else plugin_info[i].m_standby_ms = (drives[i].m_standby == true) ? (uint64_t) elapsed_ms(&drives[i].m_standby_at, &now) : 0;
+		plugin_info[i].m_spinup_ms = (resume == true) ? drives[i].m_last_spinup_ms : 0;
+	}
+	ev.m_event = event;
+	if (resume == true) ev.m_kind = PM0_EVENT_RESUME;
+	else ev.m_kind = (strcmp(event, HOOK_TRIGGER) == 0) ? PM0_EVENT_TRIGGER : PM0_EVENT_STANDBY;
+	which = (resume == true) ? PLUGIN_RESUME : ((ev.m_kind == PM0_EVENT_TRIGGER) ? PLUGIN_TRIGGER : PLUGIN_STANDBY);
+	ev.m_time = (int64_t) when;
+	ev.m_drive_count = pm0_conf.m_drive_count;
+	ev.m_info = plugin_info;
+	
+	for (i=0; (i<loaded_count) && (i<pm0_conf.m_plugin_count); i++) {
+		if ((loaded_plugins[i].m_api == NULL) || (loaded_plugins[i].m_disabled == true)) continue;
+		if ((mask & pm0_conf.m_plugins[i].m_drives) == 0) continue;
+		ev.m_drives = mask & pm0_conf.m_plugins[i].m_drives;
+		//a trigger only goes to m_on_trigger, the drive has not necessarily gone to standby
+		if ((which == PLUGIN_STANDBY) && (loaded_plugins[i].m_api->m_on_standby != NULL)) plugin_call(i, which, &ev);
+		else if ((which == PLUGIN_TRIGGER) && (loaded_plugins[i].m_api->m_on_trigger != NULL)) plugin_call(i, which, &ev);
+		else if ((which == PLUGIN_RESUME) && (loaded_plugins[i].m_api->m_on_resume != NULL)) plugin_call(i, which, &ev);
+	}
+}
+
+/*
+Calls one callback of plugin n under the watchdog, false if it has overrun. The callback
+is never jumped out of, as it may hold libc locks: the first expiry of the timer only
+marks the call, and the plugin is disabled once it returns. The timer is periodic, so
+a callback still running at the second expiry is taken to be stuck, and the daemon is
+aborted (to be restarted by its supervisor) rather than left hanging. plugin_running is
+set before the timer is armed and cleared before it is disarmed, so a SIGALRM that
+comes too late for the call finds it cleared, and is ignored.
+*/
+bool plugin_call(int n, int which, pm0_event_t const *ev) {
+	loaded_plugin_t *l = &loaded_plugins[n];
+	unsigned long timeout = (n < pm0_conf.m_plugin_count) ? pm0_conf.m_plugins[n].m_timeout : PLUGIN_TIMEOUT;
+	struct itimerspec its;
+	struct timespec start, end;
+	unsigned long us;
+	bool overrun;
+	
+	memset(&its, 0, sizeof(its));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	plugin_running = 1;
+	its.it_value.tv_sec = timeout / 1000;
+	its.it_value.tv_nsec = (timeout % 1000) * 1000000;
+	its.it_interval = its.it_value;
+	if (timeout > 0) timer_settime(plugin_timer, 0, &its, NULL);
+	switch (which) {
+		case PLUGIN_STANDBY:	l->m_api->m_on_standby(ev); break;
+		case PLUGIN_TRIGGER:	l->m_api->m_on_trigger(ev); break;
+		case PLUGIN_RESUME:		l->m_api->m_on_resume(ev); break;
+		case PLUGIN_SHUTDOWN:	l->m_api->m_shutdown(); break;
+	}
+	overrun = (plugin_running == 2) ? true : false;
+	plugin_running = 0;
+	memset(&its, 0, sizeof(its));
+	if (timeout > 0) timer_settime(plugin_timer, 0, &its, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	us = (unsigned long) ((end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000);
+	l->m_calls++;
+	l->m_call_us += us;
+	metrics_dirty = true;
+	if (overrun == true) {
+		log_msg(LOG_ERR, "Plugin %s has taken %lu us, more than its %lu ms, it won't be called again.\n", l->m_api->m_name, us, timeout);
+		l->m_disabled = true;
+		return false;
+	}
+	if ((pm0_conf.m_verbose == true) && (ev != NULL)) {
+		log_msg(LOG_INFO, "Plugin %s has handled the %s event in %lu us.\n", l->m_api->m_name, ev->m_event, us);
+	}
+	return true;
+}
+
+//SIGALRM from the watchdog timer: marks the call at the first expiry, gives up at the second
+void plugin_overrun(int sig) {
+	if (plugin_running == 0) return;
+	if (plugin_running == 1) {
+		plugin_running = 2;
+		return;
+	}
+	//so that the supervisor can start the daemon again
+	cleanup_abort();
+	abort();
+}
+
+#else //WITH_PLUGINS
+
+//read_plugins() refuses a configuration with plugins in it
+int open_plugins(void) {
+	return ALL_OK;
+}
+
+void close_plugins(void) {
+}
+
+void plugins_call(unsigned int mask, char const *event, time_t when) {
+}
+
+#endif //WITH_PLUGINS
+
+//the plugins loaded at startup stay, and so does their configuration
+void keep_plugins(conf_ptr_t next) {
+	plugin_t *kept;
+	bool changed = (next->m_plugin_count != pm0_conf.m_plugin_count) ? true : false;
+	int i;
+	
+	for (i=0; (changed == false) && (i<next->m_plugin_count); i++) {
+		if ((strcmp(next->m_plugins[i].m_path, pm0_conf.m_plugins[i].m_path) != 0) ||
+			(strcmp(next->m_plugins[i].m_arg, pm0_conf.m_plugins[i].m_arg) != 0) ||
+			(next->m_plugins[i].m_timeout != pm0_conf.m_plugins[i].m_timeout) ||
+			(next->m_plugins[i].m_drives != pm0_conf.m_plugins[i].m_drives)) changed = true;
+	}
+	if (changed == false) return;
+	
+	log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", "plugins");
+	next->m_plugins = NULL;
+	next->m_plugin_count = 0;
+	if (pm0_conf.m_plugin_count == 0) return;
+	
+	if ((kept = (plugin_t *) arena_alloc(next, pm0_conf.m_plugin_count * sizeof(plugin_t))) == NULL) {
+		log_msg(LOG_ERR, "arena_alloc() failed, the plugins won't be called any more!\n");
+		return;
+	}
+	for (i=0; i<pm0_conf.m_plugin_count; i++) {
+		kept[i] = pm0_conf.m_plugins[i];
+		if (((kept[i].m_path = arena_strdup(next, pm0_conf.m_plugins[i].m_path)) == NULL) ||
+			((kept[i].m_arg = arena_strdup(next, pm0_conf.m_plugins[i].m_arg)) == NULL)) {
+			log_msg(LOG_ERR, "arena_strdup() failed, the plugins won't be called any more!\n");
+			return;
+		}
+	}
+	next->m_plugins = kept;
+	next->m_plugin_count = pm0_conf.m_plugin_count;
+}
+
+//=========== METRICS ==========
+
+/*
+The metrics file is written as "<file>.tmp" next to it, and renamed over it, so a
+reader (e.g. the textfile collector of the Prometheus node exporter) never sees half of
+an update. Its directory is opened once, the names are looked up in it alone. Put it on
+tmpfs, or it will keep a drive awake. Strict mode does without the names: the file is
+opened once, here, and rewritten in place, so a reader may catch an update half done.
+The buffer the metrics are rendered into, for the file and for pm0ctl, is sized here
+for the drives and plugins in use, from the longest their lines can get.
+*/
+int open_metrics(void) {
+	char dir[PATH_MAX];
+	char const *slash;
+	int i;
+	
+	metrics_size = METRICS_BASE;
+	for (i=0; i<pm0_conf.m_drive_count; i++) metrics_size += METRICS_PER_DRIVE + 11 * strlen(drives[i].m_dev);
+	for (i=0; i<pm0_conf.m_plugin_count; i++) metrics_size += METRICS_PER_PLUGIN + 3 * strlen(pm0_conf.m_plugins[i].m_path);
+	if ((metrics_buf = (char *) calloc(metrics_size, sizeof(char))) == NULL) {
+		log_msg(LOG_ERR, "calloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	
+	if (pm0_conf.m_metrics_file == NULL) return ALL_OK;
+	
+	strncpy(dir, pm0_conf.m_metrics_file, PATH_MAX - 1);
+	dir[PATH_MAX - 1] = '\0';
+	if ((slash = strrchr(pm0_conf.m_metrics_file, '/')) == NULL) {
+		strcpy(dir, ".");
+		slash = pm0_conf.m_metrics_file - 1;
+	}
+	else if (slash == pm0_conf.m_metrics_file) dir[1] = '\0';
+	else dir[slash - pm0_conf.m_metrics_file] = '\0';
+	if ((strlen(slash + 1) == 0) || (strlen(slash + 1) + 4 > NAME_MAX)) {
+		log_msg(LOG_ERR, "\'%s\' is not a valid name for the metrics file!\n", pm0_conf.m_metrics_file);
+		return ERR_OPEN_FAIL;
+	}
+	strcpy(metrics_name, slash + 1);
+	snprintf(metrics_tmp, sizeof(metrics_tmp), "%s.tmp", metrics_name);
+	
+	if ((metrics_dir = open(dir, O_PATH | O_DIRECTORY | O_CLOEXEC)) == -1) {
+		log_msg(LOG_ERR, "open() failed on \'%s\': %s\n", dir, strerror(errno));
+		return ERR_OPEN_FAIL;
+	}
+	if ((pm0_conf.m_strict == true) &&
+		((metrics_fd = openat(metrics_dir, metrics_name, O_CREAT | O_WRONLY | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1)) {
+		log_msg(LOG_ERR, "open() failed on \'%s\': %s\n", pm0_conf.m_metrics_file, strerror(errno));
+		return ERR_OPEN_FAIL;
+	}
+	metrics_dirty = true;
+	return ALL_OK;
+}
+
+void close_metrics(void) {
+	if (metrics_dir != -1) {
+		write_metrics();
+		close(metrics_dir);
+		metrics_dir = -1;
+	}
+	if (metrics_fd != -1) {
+		close(metrics_fd);
+		metrics_fd = -1;
+	}
+	free(metrics_buf);
+	metrics_buf = NULL;
+}
+
+//Prometheus text exposition format
+size_t render_metrics(char *buf, size_t size) {
+	struct timespec now;
+	unsigned long long active_ms, standby_ms, ms;
+	size_t len = 0;
+	int i;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	len += snprintf(buf + len, size - len,
+		"# HELP pm0_timeout_minutes Current HDD suspend timeout.\n"
+		"# TYPE pm0_timeout_minutes gauge\n"
+		"pm0_timeout_minutes %lu\n", pm0_conf.m_timeout);
+	if (len < size) len += snprintf(buf + len, size - len,
+		"# HELP pm0_hotset_files Files of the hot set held in memory.\n"
+		"# TYPE pm0_hotset_files gauge\n"
+		"pm0_hotset_files %d\n"
+		"# HELP pm0_hotset_bytes Bytes of the hot set held in memory.\n"
+		"# TYPE pm0_hotset_bytes gauge\n"
+		"pm0_hotset_bytes %llu\n", hot_count, hot_bytes);
+	if (len < size) len += snprintf(buf + len, size - len,
+		"# HELP pm0_writeback_raised 1 if the writeback settings are raised for a drive in standby.\n"
+		"# TYPE pm0_writeback_raised gauge\n"
+		"pm0_writeback_raised %d\n", (vm_raised == true) ? 1 : 0);
+	
+#define METRIC_HEAD(name, type, help) \
+	if (len < size) len += snprintf(buf + len, size - len, "# HELP " name " " help "\n# TYPE " name " " type "\n")
+#define METRIC_DRIVE(name, fmt, value) \
+	if (len < size) len += snprintf(buf + len, size - len, name "{drive=\"%d\",dev=\"%s\"} " fmt "\n", i, drives[i].m_dev, value)
+	
+	METRIC_HEAD("pm0_drive_standby", "gauge", "1 if the drive is known to be in standby.");
+	for (i=0; i<pm0_conf.m_drive_count; i++) { METRIC_DRIVE("pm0_drive_standby", "%d", (drives[i].m_standby == true) ? 1 : 0); }
+	METRIC_HEAD("pm0_standby_entries_total", "counter", "Standby events signalled for the drive.");
+	for (i=0; i<pm0_conf.m_drive_count; i++) { METRIC_DRIVE("pm0_standby_entries_total", "%lu", drives[i].m_events); }
+	METRIC_HEAD("pm0_spinups_total", "counter", "Spin-ups inferred from the I/O counters after a standby.");
+	for (i=0; i<pm0_conf.m_drive_count; i++) { METRIC_DRIVE("pm0_spinups_total", "%lu", drives[i].m_spinups); }
+	METRIC_HEAD("pm0_spinup_seconds_total", "counter", "Time the drive has spent spinning up, from its I/O time after a standby.");
+	for (i=0; (i<pm0_conf.m_drive_count) && (len < size); i++) {
+		len += snprintf(buf + len, size - len, "pm0_spinup_seconds_total{drive=\"%d\",dev=\"%s\"} %llu.%03llu\n",
+			i, drives[i].m_dev, drives[i].m_spinup_ms / 1000, drives[i].m_spinup_ms % 1000);
+	}
+	
+	METRIC_HEAD("pm0_state_seconds_total", "counter", "Time spent in each power state.");
+	for (i=0; (i<pm0_conf.m_drive_count) && (len < size); i++) {
+		active_ms = drives[i].m_active_ms;
+		standby_ms = drives[i].m_standby_ms;
+		ms = (unsigned long long) elapsed_ms(&drives[i].m_state_since, &now);
+		if (drives[i].m_standby == true) standby_ms += ms;
+		else active_ms += ms;
+		len += snprintf(buf + len, size - len,
+			"pm0_state_seconds_total{drive=\"%d\",dev=\"%s\",state=\"active\"} %llu.%03llu\n",
+			i, drives[i].m_dev, active_ms / 1000, active_ms % 1000);
+		if (len < size) len += snprintf(buf + len, size - len,
+			"pm0_state_seconds_total{drive=\"%d\",dev=\"%s\",state=\"standby\"} %llu.%03llu\n",
+			i, drives[i].m_dev, standby_ms / 1000, standby_ms % 1000);
+	}
+	
+	METRIC_HEAD("pm0_hook_launches_total", "counter", "Suspend hook runs started for the drive.");
+	for (i=0; i<pm0_conf.m_drive_count; i++) { METRIC_DRIVE("pm0_hook_launches_total", "%lu", drives[i].m_hook_launches); }
+	METRIC_HEAD("pm0_hook_failures_total", "counter", "Suspend hook runs that could not be started or exited with an error.");
+	for (i=0; i<pm0_conf.m_drive_count; i++) { METRIC_DRIVE("pm0_hook_failures_total", "%lu", drives[i].m_hook_failures); }
+	METRIC_HEAD("pm0_hook_skips_total", "counter", "Suspend hook runs not started, the hook was still running max_running times.");
+	for (i=0; i<pm0_conf.m_drive_count; i++) { METRIC_DRIVE("pm0_hook_skips_total", "%lu", drives[i].m_hook_skips); }
+	METRIC_HEAD("pm0_hook_duration_seconds", "summary", "Run time of the finished suspend hooks.");
+	for (i=0; (i<pm0_conf.m_drive_count) && (len < size); i++) {
+		len += snprintf(buf + len, size - len, "pm0_hook_duration_seconds_sum{drive=\"%d\",dev=\"%s\"} %llu.%03llu\n",
+			i, drives[i].m_dev, drives[i].m_hook_ms / 1000, drives[i].m_hook_ms % 1000);
+		METRIC_DRIVE("pm0_hook_duration_seconds_count", "%lu", drives[i].m_hook_runs);
+	}
+	
+	METRIC_HEAD("pm0_plugin_calls_total", "counter", "Plugin callbacks that have returned.");
+	for (i=0; (i<loaded_count) && (i<pm0_conf.m_plugin_count) && (len < size); i++) {
+		len += snprintf(buf + len, size - len, "pm0_plugin_calls_total{plugin=\"%s\"} %lu\n", pm0_conf.m_plugins[i].m_path, loaded_plugins[i].m_calls);
+	}
+	METRIC_HEAD("pm0_plugin_call_seconds_total", "counter", "Time spent in the callbacks of the plugin.");
+	for (i=0; (i<loaded_count) && (i<pm0_conf.m_plugin_count) && (len < size); i++) {
+		len += snprintf(buf + len, size - len, "pm0_plugin_call_seconds_total{plugin=\"%s\"} %llu.%06llu\n", pm0_conf.m_plugins[i].m_path,
+			loaded_plugins[i].m_call_us / 1000000, loaded_plugins[i].m_call_us % 1000000);
+	}
+	METRIC_HEAD("pm0_plugin_abandoned", "gauge", "1 if the plugin has been disabled for overrunning its timeout.");
+	for (i=0; (i<loaded_count) && (i<pm0_conf.m_plugin_count) && (len < size); i++) {
+		len += snprintf(buf + len, size - len, "pm0_plugin_abandoned{plugin=\"%s\"} %d\n", pm0_conf.m_plugins[i].m_path,
+			(loaded_plugins[i].m_disabled == true) ? 1 : 0);
+	}
+	
+#undef METRIC_HEAD
+#undef METRIC_DRIVE
+	
+	//only if the sizing in open_metrics() is off: a cut line would be read as a wrong value
+	if (len >= size) {
+		for (len = size - 1; (len > 0) && (buf[len - 1] != '\n'); len--);
+		buf[len] = '\0';
+		if (metrics_cut == false) log_msg(LOG_WARNING, "The metrics don't fit in %lu bytes, the last ones are left out.\n", (unsigned long) size);
+		metrics_cut = true;
+	}
+	return len;
+}
+
+void write_metrics(void) {
+	size_t len;
+	int fd;
+	
+	metrics_dirty = false;
+	if (metrics_dir == -1) return;
+	
+	len = render_metrics(metrics_buf, metrics_size);
+	if (metrics_fd != -1) {
+		if ((pwrite(metrics_fd, metrics_buf, len, 0) != (ssize_t) len) || (ftruncate(metrics_fd, len) == -1)) {
+			log_msg(LOG_WARNING, "Updating \'%s\' failed: %s\n", pm0_conf.m_metrics_file, strerror(errno));
+		}
+		return;
+	}
+	if ((fd = openat(metrics_dir, metrics_tmp, O_CREAT | O_TRUNC | O_WRONLY | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
+		log_msg(LOG_WARNING, "Updating \'%s\' failed: %s\n", pm0_conf.m_metrics_file, strerror(errno));
+		return;
+	}
+	if (write(fd, metrics_buf, len) != (ssize_t) len) {
+		log_msg(LOG_WARNING, "Updating \'%s\' failed: %s\n", pm0_conf.m_metrics_file, strerror(errno));
+		close(fd);
+		unlinkat(metrics_dir, metrics_tmp, 0);
+		return;
+	}
+	close(fd);
+	if (renameat(metrics_dir, metrics_tmp, metrics_dir, metrics_name) == -1) {
+		log_msg(LOG_WARNING, "rename() failed on \'%s.tmp\': %s\n", pm0_conf.m_metrics_file, strerror(errno));
+		unlinkat(metrics_dir, metrics_tmp, 0);
+	}
+}
+
+//=========== SCHEDULE ==========
+
+#ifdef WITH_LIBCONFIG
+
+//	schedule = ( { drive = 0; at = "02:00"; days = "12345"; prewake = 30; duration = 60; timeout = 90; } );
+int read_schedule(config_setting_t *list, conf_ptr_t target) {
+	config_setting_t *entry;
+	window_t *w;
+	char const *tmp_s;
+	int tmp_i, i, n;
+	
+	if ((config_setting_type(list) != CONFIG_TYPE_LIST) && (config_setting_type(list) != CONFIG_TYPE_ARRAY)) {
+		fprintf(stderr, "The setting schedule is not of type LIST!\n");
+		return ERR_SCHEDULE;
+	}
+	
+	if ((n = config_setting_length(list)) == 0) return ALL_OK;
+	if ((target->m_windows = (window_t *) arena_alloc(target, n * sizeof(window_t))) == NULL) {
+		fprintf(stderr, "arena_alloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	
+	for (i=0; i<n; i++) {
+		entry = config_setting_get_elem(list, i);
+		w = &target->m_windows[target->m_window_count];
+		
+		w->m_days = SCHED_ALL_DAYS;
+		w->m_prewake = SCHED_PREWAKE;
+		w->m_duration = SCHED_DURATION;
+		
+		if ((config_setting_lookup_int(entry, "drive", &w->m_drive) != CONFIG_TRUE) || (w->m_drive < 0) || (w->m_drive >= target->m_drive_count)) {
+			fprintf(stderr, "Schedule entry %d has no valid \'drive\', ignoring it.\n", i+1);
+			continue;
+		}
+		if ((config_setting_lookup_string(entry, "at", &tmp_s) != CONFIG_TRUE) ||
+			(sscanf(tmp_s, "%d:%d", &w->m_hour, &w->m_minute) != 2) ||
+			(w->m_hour < 0) || (w->m_hour > 23) || (w->m_minute < 0) || (w->m_minute > 59)) {
+			fprintf(stderr, "Schedule entry %d has no valid \'at\' (HH:MM), ignoring it.\n", i+1);
+			continue;
+		}
+		if (config_setting_lookup_string(entry, "days", &tmp_s) == CONFIG_TRUE) {
+			for (w->m_days = 0; *tmp_s != '\0'; tmp_s++) {
+				if ((*tmp_s >= '0') && (*tmp_s <= '6')) w->m_days |= (1u << (*tmp_s - '0'));
+			}
+		}
+		if ((config_setting_lookup_int(entry, "prewake", &tmp_i) == CONFIG_TRUE) && (tmp_i >= 0)) w->m_prewake = tmp_i;
+		if ((config_setting_lookup_int(entry, "duration", &tmp_i) == CONFIG_TRUE) && (tmp_i > 0)) w->m_duration = tmp_i;
+		if ((config_setting_lookup_int(entry, "timeout", &tmp_i) == CONFIG_TRUE) && (tmp_i > 0)) w->m_timeout = tmp_i;
+		else w->m_timeout = w->m_duration;
+		
+		if (target->m_verbose == true) {
+			fprintf(stderr, "Scheduled window %d: HDD-%d at %02d:%02d for %lu minute(s).\n", i+1, w->m_drive, w->m_hour, w->m_minute, w->m_duration);
+		}
+		target->m_window_count++;
+	}
+	return ALL_OK;
+}
+
+#endif //WITH_LIBCONFIG
+
+//the start of the first window of w that has not ended by now
+time_t window_start(window_t const *w, time_t now) {
+	struct tm tm_now, tm_day;
+	time_t start;
+	int d;
+	
+	localtime_r(&now, &tm_now);
+	for (d=-1; d<=7; d++) {
+		tm_day = tm_now;
+		tm_day.tm_mday += d;
+		tm_day.tm_hour = w->m_hour;
+		tm_day.tm_min = w->m_minute;
+		tm_day.tm_sec = 0;
+		tm_day.tm_isdst = -1;
+		if ((start = mktime(&tm_day)) == (time_t) -1) continue;
+		if ((w->m_days & (1u << tm_day.tm_wday)) == 0) continue;
+		if (start + (time_t) (w->m_duration * 60) > now) return start;
+	}
+	return (time_t) -1;
+}
+
+int open_schedule(void) {
+	char path[PATH_MAX];
+	int i, n;
+	
+	if (pm0_conf.m_window_count == 0) {
+		//a reload may have emptied the schedule
+		if (ev_schedule.m_fd != -1) ev_arm(&ev_schedule, 0, 0);
+		return ALL_OK;
+	}
+	
+	//the devices are opened now, so that waking a drive needs no path lookup
+	for (i=0; i<pm0_conf.m_window_count; i++) {
+		n = pm0_conf.m_windows[i].m_drive;
+		if (drives[n].m_wake_fd != -1) continue;
+		snprintf(path, PATH_MAX, "%s/%s", DEV_ROOT, drives[n].m_dev);
+		if ((drives[n].m_wake_fd = open(path, O_RDONLY | O_DIRECT | O_CLOEXEC)) == -1) {
+			log_msg(LOG_WARNING, "open() failed on \'%s\', HDD-%d won't be woken for its windows: %s\n", path, n, strerror(errno));
+		}
+	}
+	
+	if ((ev_schedule.m_fd == -1) && ((i = ev_add(&ev_schedule, timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC), on_schedule)) != ALL_OK)) return i;
+	
+	//opens the windows we are already in, and arms the timer for the next one
+	on_schedule(&ev_schedule);
+	return ALL_OK;
+}
+
+/*
+Opens the windows whose pre-wake time has come: the drive is woken and the timeout
+is raised to the largest one of the open windows. When the last window closes, the
+timeout returns to what it was before. The timer is then armed for the next instant
+at which a window opens or closes.
+*/
+void on_schedule(ev_source_t *src) {
+	struct itimerspec its;
+	unsigned long timeout;
+	time_t now, start, next = 0;
+	window_t *w;
+	int i;
+	
+	ev_expired(src);
+	now = time(NULL);
+	
+	for (i=0; i<pm0_conf.m_window_count; i++) {
+		w = &pm0_conf.m_windows[i];
+		
+		if ((w->m_active == true) && (now >= w->m_end)) {
+			w->m_active = false;
+			windows_active--;
+			log_msg(LOG_NOTICE, "Scheduled window of HDD-%d (%02d:%02d) has closed.\n", w->m_drive, w->m_hour, w->m_minute);
+		}
+		
+		if ((w->m_active == false) && ((start = window_start(w, now)) != (time_t) -1)) {
+			if (now >= start - (time_t) w->m_prewake) {
+				w->m_active = true;
+				w->m_end = start + (time_t) (w->m_duration * 60);
+				if (windows_active++ == 0) base_timeout = pm0_conf.m_timeout;
+				log_msg(LOG_NOTICE, "Waking HDD-%d for the scheduled window at %02d:%02d.\n", w->m_drive, w->m_hour, w->m_minute);
+				drive_wake(w->m_drive);
+			}
+			else if ((next == 0) || (start - (time_t) w->m_prewake < next)) next = start - (time_t) w->m_prewake;
+		}
+		
+		if ((w->m_active == true) && ((next == 0) || (w->m_end < next))) next = w->m_end;
+	}
+	
+	//the open windows decide the timeout
+	timeout = (windows_active > 0) ? base_timeout : 0;
+	for (i=0; i<pm0_conf.m_window_count; i++) {
+		if ((pm0_conf.m_windows[i].m_active == true) && (pm0_conf.m_windows[i].m_timeout > timeout)) timeout = pm0_conf.m_windows[i].m_timeout;
+	}
+	if ((windows_active == 0) && (base_timeout != 0)) {
+		timeout = base_timeout;
+		base_timeout = 0;
+	}
+	if ((timeout != 0) && (timeout != pm0_conf.m_timeout)) {
+		log_msg(LOG_NOTICE, "Suspend timeout set to %lu minute(s) by the schedule.\n", timeout);
+		if (pm0_conf.m_backend->m_set_idletime(timeout) == ALL_OK) pm0_conf.m_timeout = timeout;
+	}
+	
+	if (next != 0) {
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = next;
+		if (timerfd_settime(src->m_fd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+			log_msg(LOG_ERR, "timerfd_settime() failed: %s\n", strerror(errno));
+		}
+	}
+}
+
+//=========== LOGGING ==========
+
+/*
+syslogd writes to /var/log, which may well live on a sleeping drive. While a drive is
+in standby, log_msg() keeps the lines in a buffer preallocated by init_log(), and they
+are passed on to syslog in one batch once a drive spins up again, or the buffer fills up.
+Each record is the priority byte followed by the NUL-terminated line.
+*/
+void log_msg(int prio, char const *fmt, ...) {
+	char line[LOG_LINE_LENGTH];
+	struct tm tm_buf;
+	time_t now;
+	size_t len, stamp;
+	va_list ap;
+	
+	//the lines are held until no drive sleeps, acting on the resume is left to the event loop
+	if ((log_ring != NULL) && (drives_asleep() == true)) drives_check();
+	
+	if ((log_ring == NULL) || (drives_asleep() == false)) {
+		if (log_ring_used > 0) flush_log();
+		va_start(ap, fmt);
+		vsyslog(prio, fmt, ap);
+		va_end(ap);
+		return;
+	}
+	
+	//remember when the line was logged, syslog will only see the time of the flush
+	now = time(NULL);
+	stamp = strftime(line, LOG_LINE_LENGTH, "[%H:%M:%S] ", localtime_r(&now, &tm_buf));
+	va_start(ap, fmt);
+	vsnprintf(line + stamp, LOG_LINE_LENGTH - stamp, fmt, ap);
+	va_end(ap);
+	len = strlen(line) + 1;
+	
+	if (log_ring_used + len + 1 > pm0_conf.m_log_buffer) flush_log();
+	if (len + 1 > pm0_conf.m_log_buffer) {
+		syslog(prio, "%s", line);
+		return;
+	}
+	
+	log_ring[log_ring_used] = (char) prio;
+	memcpy(log_ring + log_ring_used + 1, line, len);
+	log_ring_used += len + 1;
+}
+
+int init_log(void) {
+	if (pm0_conf.m_log_buffer == 0) return ALL_OK;
+	
+	if ((log_ring = (char *) calloc(pm0_conf.m_log_buffer, sizeof(char))) == NULL) {
+		syslog(LOG_ERR, "calloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	return ALL_OK;
+}
+
+void flush_log(void) {
+	size_t pos = 0;
+	
+	while (pos < log_ring_used) {
+		syslog((int) log_ring[pos], "%s", log_ring + pos + 1);
+		pos += strlen(log_ring + pos + 1) + 2;
+	}
+	log_ring_used = 0;
+}
+
+#ifdef _GNU_SOURCE
+//the write function of the stream log_stderr() sets up, which is line buffered, so buf is usually one line
+ssize_t log_write(void *cookie, char const *buf, size_t size) {
+	log_msg(LOG_NOTICE, "%.*s", (int) size, buf);
+	return size;
+}
+#endif /* _GNU_SOURCE */
+
+/*
+Descriptors 0-2 are closed in the daemon, and may well be reused by the ones we open,
+so what load_conf() has to say on a reload must not go to descriptor 2: it goes to the log.
+*/
+void log_stderr(void) {
+#ifdef _GNU_SOURCE
+	cookie_io_functions_t funcs = { NULL, log_write, NULL, NULL };
+	FILE *stream;
+	
+	if ((stream = fopencookie(NULL, "w", funcs)) != NULL) {
+		setvbuf(stream, NULL, _IOLBF, 0);
+		stderr = stream;
+		return;
+	}
+#endif /* _GNU_SOURCE */
+	if (freopen("/dev/null", "w", stderr) == NULL) syslog(LOG_WARNING, "freopen() failed on stderr: %s\n", strerror(errno));
+}
+
+void release_log(void) {
+	if (log_ring != NULL) {
+		flush_log();
+		free(log_ring);
+		log_ring = NULL;
+	}
+}
+
+//=========== DRIVES ==========
+
+/*
+The I/O counters in sysfs are kept by the kernel, reading them never reaches the drive.
+A drive whose counters can't be read is never considered to be asleep, because we
+would have no way of telling when it wakes up. The files stay open for the life of the
+daemon, so they are not passed on to the hooks.
+*/
+void open_drives(void) {
+	char path[PATH_MAX];
+	int i;
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		drives[i].m_dev = (pm0_conf.m_drive_dev[i] != NULL) ? pm0_conf.m_drive_dev[i] : default_drive_dev[i];
+		drives[i].m_standby = false;
+		drives[i].m_io = 0;
+		drives[i].m_wake_fd = -1;
+		clock_gettime(CLOCK_MONOTONIC, &drives[i].m_state_since);
+		snprintf(path, PATH_MAX, "%s/block/%s/stat", sys_root(), drives[i].m_dev);
+		if ((drives[i].m_stat_fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+			if (pm0_conf.m_verbose == true) {
+				log_msg(LOG_INFO, "No I/O statistics for HDD-%d at \'%s\': %s\n", i, path, strerror(errno));
+			}
+		}
+	}
+}
+
+void close_drives(void) {
+	int i;
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if (drives[i].m_stat_fd != -1) {
+			close(drives[i].m_stat_fd);
+			drives[i].m_stat_fd = -1;
+		}
+		if (drives[i].m_wake_fd != -1) {
+			close(drives[i].m_wake_fd);
+			drives[i].m_wake_fd = -1;
+		}
+		drives[i].m_standby = false;
+	}
+}
+
+//completed reads plus completed writes
+bool drive_io(int n, unsigned long long *io) {
+	unsigned long in_flight;
+	unsigned long long io_ticks;
+	
+	return drive_stat(n, io, &in_flight, &io_ticks);
+}
+
+//also the requests in the queue of the drive, and the milliseconds it has spent doing I/O
+bool drive_stat(int n, unsigned long long *io, unsigned long *in_flight, unsigned long long *io_ticks) {
+	char buf[STAT_BUF_LENGTH];
+	unsigned long long rd, wr;
+	ssize_t len;
+	
+	if (drives[n].m_stat_fd == -1) return false;
+	if ((len = pread(drives[n].m_stat_fd, buf, STAT_BUF_LENGTH-1, 0)) <= 0) return false;
+	buf[len] = '\0';
+	if (sscanf(buf, "%llu %*u %*u %*u %llu %*u %*u %*u %lu %llu", &rd, &wr, in_flight, io_ticks) != 4) return false;
+	*io = rd + wr;
+	return true;
+}
+
+void drive_standby(int n) {
+	unsigned long in_flight;
+	
+	if ((n < 0) || (n >= pm0_conf.m_drive_count)) return;
+	journal_write(JOURNAL_STANDBY, 1u << n, 0, 0, 0);
+	drives[n].m_event_times[drives[n].m_events % EVENT_HISTORY] = time(NULL);
+	drives[n].m_events++;
+	clock_gettime(CLOCK_MONOTONIC, &drives[n].m_standby_at);
+	if (drive_stat(n, &drives[n].m_io, &in_flight, &drives[n].m_io_ticks) == true) {
+		drive_state(n, true, &drives[n].m_standby_at);
+		attr_arm(n);
+		laptop_raise();
+		if (ev_resume.m_fd != -1) ev_arm(&ev_resume, RESUME_POLL, RESUME_POLL);
+	}
+	metrics_dirty = true;
+}
+
+bool drives_asleep(void) {
+	int i;
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if (drives[i].m_standby == true) return true;
+	}
+	return false;
+}
+
+//books the time spent in the current state, then switches to the new one
+void drive_state(int n, bool standby, struct timespec const *now) {
+	unsigned long long ms = (unsigned long long) elapsed_ms(&drives[n].m_state_since, now);
+	
+	if (drives[n].m_standby == true) drives[n].m_standby_ms += ms;
+	else drives[n].m_active_ms += ms;
+	drives[n].m_state_since = *now;
+	drives[n].m_standby = standby;
+	drives[n].m_power = (standby == true) ? DRIVE_STANDBY : DRIVE_ACTIVE;
+}
+
+//a drive that is up is idle when it has done no I/O since the last tick
+void drives_idle(void) {
+	unsigned long long io;
+	int i;
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if ((drives[i].m_standby == true) || (drive_io(i, &io) == false)) continue;
+		drives[i].m_power = (io == drives[i].m_tick_io) ? DRIVE_IDLE : DRIVE_ACTIVE;
+		drives[i].m_tick_io = io;
+	}
+}
+
+/*
+True if any sleeping drive has done I/O since it went to standby. A request waiting in the
+queue of a sleeping drive, with nothing completed yet, means it is spinning up. Once the
+request completes, the milliseconds the drive has spent doing I/O since the standby are
+(all but) the time the spin-up took. This only books the new state, and marks the drive
+in spinup_drives or resumed_drives: log_msg() calls it, so it must not log, fork or run
+anything itself.
+*/
+bool drives_check(void) {
+	unsigned long long io, io_ticks;
+	unsigned long in_flight;
+	struct timespec now;
+	bool woken = false;
+	int i;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if ((drives[i].m_standby == false) || (drive_stat(i, &io, &in_flight, &io_ticks) == false)) continue;
+		if (io == drives[i].m_io) {
+			if ((in_flight > 0) && (drives[i].m_power == DRIVE_STANDBY)) {
+				drives[i].m_power = DRIVE_SPINUP;
+				spinup_drives |= (1u << i);
+			}
+			continue;
+		}
+		drive_state(i, false, &now);
+		drives[i].m_tick_io = io;
+		drives[i].m_spinups++;
+		drives[i].m_last_standby_ms = elapsed_ms(&drives[i].m_standby_at, &now);
+		drives[i].m_last_spinup_ms = (io_ticks >= drives[i].m_io_ticks) ? io_ticks - drives[i].m_io_ticks : 0;
+		drives[i].m_spinup_ms += drives[i].m_last_spinup_ms;
+		metrics_dirty = true;
+		journal_write(JOURNAL_SPINUP, 1u << i, 0, 0, drives[i].m_last_standby_ms);
+		resumed_drives |= (1u << i);
+		woken = true;
+	}
+	return woken;
+}
+
+/*
+Acts on the drives drives_check() has seen resuming: held log lines go out, the rest of
+their groups are woken, and the resume hooks are run. Only called from the top of the
+event loop and from event handlers, never from within other code. The mask is taken
+first, so that a resume seen meanwhile waits for the next round.
+*/
+void drives_dispatch(void) {
+	unsigned int woken = resumed_drives;
+	unsigned int spinning = spinup_drives;
+	unsigned long gap;
+	int i;
+	
+	resumed_drives = 0;
+	spinup_drives = 0;
+	
+	//a spin-up too short to be seen in the queue still wakes the rest of the group
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if (((spinning | woken) & (1u << i)) != 0) group_wake(i);
+	}
+	if (woken == 0) return;
+	laptop_resumed(woken);
+	
+	if (log_ring_used > 0) flush_log();
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if ((woken & (1u << i)) == 0) continue;
+		gap = drives[i].m_last_standby_ms / 1000;
+		if (pm0_conf.m_verbose == true) {
+			log_msg(LOG_INFO, "HDD-%d has resumed after %lu s in standby, spinning up took %lu ms.\n",
+				i, gap, drives[i].m_last_spinup_ms);
+		}
+		attr_report(i, gap);
+		if (pm0_conf.m_adaptive == true) adapt_timeout(i, gap);
+	}
+	exec_suspend(woken, HOOK_RESUME, time(NULL));
+}
+
+//for the event handlers: notices a resume and acts on it right away
+bool drives_resumed(void) {
+	bool woken = drives_check();
+	
+	drives_dispatch();
+	return woken;
+}
+
+/*
+Spins a drive up by reading a block from a random spot with O_DIRECT, so neither the
+page cache nor the drive's own cache can answer it. The read takes as long as the
+spin-up, so it is done by a child, which is reaped through SIGCHLD.
+*/
+void drive_wake(int n) {
+	unsigned long long size = 0;
+	void *block;
+	off_t offset = 0;
+	pid_t cp;
+	int fd = drives[n].m_wake_fd;
+	
+	if (fd == -1) return;
+	
+	if ((cp = fork()) == -1) {
+		log_msg(LOG_ERR, "fork() failed: %s\n", strerror(errno));
+		return;
+	}
+	if (cp > 0) return;
+	
+	if ((ioctl(fd, BLKGETSIZE64, &size) == 0) && (size > WAKE_BLOCK)) {
+		srand(time(NULL) ^ getpid());
+		offset = (off_t) (((unsigned long long) rand() * WAKE_BLOCK) % (size - WAKE_BLOCK));
+		offset -= offset % WAKE_BLOCK;
+	}
+	if (posix_memalign(&block, WAKE_BLOCK, WAKE_BLOCK) != 0) _exit(ERR_OUT_OF_MEMORY);
+	if (pread(fd, block, WAKE_BLOCK, offset) == -1) _exit(ERR_OPEN_FAIL);
+	_exit(ALL_OK);
+}
+
+//the roots of procfs and sysfs, main.proc_root and main.sys_root point them at a copy for testing
+char const *proc_root(void) {
+	return (pm0_conf.m_proc_root != NULL) ? pm0_conf.m_proc_root : PROC_ROOT;
+}
+
+char const *sys_root(void) {
+	return (pm0_conf.m_sys_root != NULL) ? pm0_conf.m_sys_root : SYS_ROOT;
+}
+
+/*
+The file systems mounted from the drives are looked up once, at startup, and kept open,
+for attribution to watch and for laptop mode to flush. A file system mounted later is
+not seen until a restart.
+*/
+int open_mounts(void) {
+	char line[PATH_MAX], dir[PATH_MAX], path[PATH_MAX];
+	unsigned int major, minor, c;
+	struct stat st;
+	FILE *mounts;
+	char *p, *q;
+	int mnt_fd, n;
+	
+	if ((pm0_conf.m_attribution == false) && (pm0_conf.m_laptop_mode == false)) return ALL_OK;
+	
+	snprintf(path, PATH_MAX, "%s/self/mountinfo", proc_root());
+	if ((mounts = fopen(path, "re")) == NULL) {
+		log_msg(LOG_WARNING, "fopen() failed on \'%s\', no file system of the drives is known: %s\n", path, strerror(errno));
+		return ALL_OK;
+	}
+	
+	while ((drive_mount_count < DRIVE_MOUNTS) && (fgets(line, PATH_MAX, mounts) != NULL)) {
+		if (sscanf(line, "%*d %*d %u:%u %*s %s", &major, &minor, dir) != 3) continue;
+		if ((n = mount_drive_of(major, minor)) == -1) continue;
+		
+		//spaces and the like are escaped as "\040"
+		for (p = q = dir; *p != '\0'; q++) {
+			if ((p[0] == '\\') && (sscanf(p + 1, "%3o", &c) == 1)) {
+				*q = (char) c;
+				p += 4;
+			}
+			else *q = *(p++);
+		}
+		*q = '\0';
+		
+		if ((mnt_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+			log_msg(LOG_WARNING, "open() failed on \'%s\': %s\n", dir, strerror(errno));
+			continue;
+		}
+		fstat(mnt_fd, &st);
+		drive_mounts[drive_mount_count].m_drive = n;
+		drive_mounts[drive_mount_count].m_fd = mnt_fd;
+		drive_mounts[drive_mount_count].m_dev = st.st_dev;
+		drive_mount_count++;
+		if (pm0_conf.m_verbose == true) {
+			log_msg(LOG_INFO, "\'%s\' is mounted from HDD-%d.\n", dir, n);
+		}
+	}
+	fclose(mounts);
+	return ALL_OK;
+}
+
+void close_mounts(void) {
+	int i;
+	
+	for (i=0; i<drive_mount_count; i++) close(drive_mounts[i].m_fd);
+	drive_mount_count = 0;
+}
+
+//the drive a block device belongs to: sysfs links a partition to ".../block/sda/sda1"
+int mount_drive_of(unsigned int major, unsigned int minor) {
+	char path[PATH_MAX], link[PATH_MAX];
+	char const *p;
+	ssize_t len;
+	size_t dev_len;
+	int i;
+	
+	snprintf(path, PATH_MAX, "%s/dev/block/%u:%u", sys_root(), major, minor);
+	if ((len = readlink(path, link, PATH_MAX-1)) == -1) return -1;
+	link[len] = '\0';
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		dev_len = strlen(drives[i].m_dev);
+		for (p = strstr(link, drives[i].m_dev); p != NULL; p = strstr(p + 1, drives[i].m_dev)) {
+			if ((p > link) && (p[-1] == '/') && ((p[dev_len] == '/') || (p[dev_len] == '\0'))) return i;
+		}
+	}
+	return -1;
+}
+
+//=========== GROUPS ==========
+
+/*
+The members of a mirror or a stripe are woken by the md layer one after the other, as
+each is needed, so the first access to the array waits for several spin-ups in a row.
+As soon as one member of a group is seen spinning up (or up), the others still in
+standby are woken in parallel with it, through the same O_DIRECT read as the scheduled
+windows use. With the diskstats backend, the group goes to standby as a whole, once none
+of its members has done I/O for the timeout of the group.
+*/
+#ifdef WITH_LIBCONFIG
+
+//	groups = ( { drives = [ 0, 1 ]; timeout = 20; } );
+int read_groups(config_setting_t *list, conf_ptr_t target) {
+	config_setting_t *entry;
+	unsigned int taken = 0;
+	group_t *g;
+	int tmp_i, i, n;
+	
+	if ((config_setting_type(list) != CONFIG_TYPE_LIST) && (config_setting_type(list) != CONFIG_TYPE_ARRAY)) {
+		fprintf(stderr, "The setting groups is not of type LIST!\n");
+		return ERR_GROUPS;
+	}
+	
+	if ((n = config_setting_length(list)) == 0) return ALL_OK;
+	if ((target->m_groups = (group_t *) arena_alloc(target, n * sizeof(group_t))) == NULL) {
+		fprintf(stderr, "arena_alloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	
+	for (i=0; i<n; i++) {
+		entry = config_setting_get_elem(list, i);
+		g = &target->m_groups[target->m_group_count];
+		
+		g->m_drives = 0;
+		if ((read_drives(config_setting_get_member(entry, "drives"), target, &g->m_drives) != ALL_OK) || (g->m_drives == 0)) {
+			fprintf(stderr, "Group %d has no valid 'drives'!\n", i+1);
+			return ERR_GROUPS;
+		}
+		if ((g->m_drives & taken) != 0) {
+			fprintf(stderr, "Group %d has a drive of an earlier group, a drive can only be in one group!\n", i+1);
+			return ERR_GROUPS;
+		}
+		taken |= g->m_drives;
+		if ((config_setting_lookup_int(entry, "timeout", &tmp_i) == CONFIG_TRUE) && (tmp_i > 0)) g->m_timeout = tmp_i;
+		
+		if (target->m_verbose == true) {
+			fprintf(stderr, "Group %d: drives 0x%x, timeout %lu minute(s).\n", i+1, g->m_drives, g->m_timeout);
+		}
+		target->m_group_count++;
+	}
+	return ALL_OK;
+}
+
+#endif //WITH_LIBCONFIG
+
+//the devices are opened now, so that waking a member needs no path lookup
+int open_groups(void) {
+	char path[PATH_MAX];
+	int i;
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if ((group_of(i) == -1) || (drives[i].m_wake_fd != -1)) continue;
+		snprintf(path, PATH_MAX, "%s/%s", DEV_ROOT, drives[i].m_dev);
+		if ((drives[i].m_wake_fd = open(path, O_RDONLY | O_DIRECT | O_CLOEXEC)) == -1) {
+			log_msg(LOG_WARNING, "open() failed on '%s', HDD-%d won't be woken with its group: %s\n", path, i, strerror(errno));
+		}
+	}
+	return ALL_OK;
+}
+
+//the index of the group of the drive, -1 if it is in none
+int group_of(int n) {
+	int i;
+	
+	for (i=0; i<pm0_conf.m_group_count; i++) {
+		if ((pm0_conf.m_groups[i].m_drives & (1u << n)) != 0) return i;
+	}
+	return -1;
+}
+
+//wakes the members of the group of n that are still asleep, and not being woken already
+void group_wake(int n) {
+	int g, i;
+	
+	if ((g = group_of(n)) == -1) return;
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if ((i == n) || ((pm0_conf.m_groups[g].m_drives & (1u << i)) == 0)) continue;
+		if ((drives[i].m_power != DRIVE_STANDBY) || (drives[i].m_wake_fd == -1)) continue;
+		log_msg(LOG_NOTICE, "Waking HDD-%d along with HDD-%d, its group mate.\n", i, n);
+		drives[i].m_power = DRIVE_SPINUP;
+		drive_wake(i);
+	}
+}
+
+//=========== LAPTOP MODE ==========
+
+/*
+While a drive is in standby, anything written to its file systems would spin it up as
+soon as the flusher threads get to it, half a minute later by default. So the writeback
+settings under <proc root>/sys/vm are raised when the first drive goes to standby, and
+dirty data piles up in memory instead. When a drive is seen to have resumed, its file
+systems are flushed with syncfs() right away, while it is spinning anyway. The settings
+are global, so they only go back to their startup values once no drive is in standby,
+and when the daemon exits. Their files are opened at startup, writing them takes no
+path lookup, and reaches no disk. The startup values are saved to VM_STATE_FILE before
+anything is raised, and the file is removed on a clean exit: one found at startup was
+left by a daemon that has died, so the settings read now may be its raised ones, and
+the saved values are put back instead. Without the state file, laptop mode is refused
+when a setting already has its standby value, as it could not be told apart.
+*/
+int open_laptop_mode(void) {
+	char path[PATH_MAX];
+	int i;
+	
+	if (pm0_conf.m_laptop_mode == false) return ALL_OK;
+	
+	for (i=0; i<VM_KNOBS; i++) {
+		snprintf(path, PATH_MAX, "%s/sys/vm/%s", proc_root(), vm_knobs[i].m_name);
+		if ((vm_knobs[i].m_fd = open(path, O_RDWR | O_CLOEXEC)) == -1) {
+			log_msg(LOG_WARNING, "open() failed on \'%s\', it won't be raised in standby: %s\n", path, strerror(errno));
+			continue;
+		}
+		if (vm_read(&vm_knobs[i], &vm_knobs[i].m_normal) == false) {
+			log_msg(LOG_WARNING, "\'%s\' could not be read, it won't be raised in standby.\n", path);
+			close(vm_knobs[i].m_fd);
+			vm_knobs[i].m_fd = -1;
+			continue;
+		}
+		//writing a ratio would clear the byte limit that is in effect instead
+		if ((vm_knobs[i].m_ratio == true) && (vm_knobs[i].m_normal == 0)) {
+			log_msg(LOG_WARNING, "vm.%s is 0, the byte limit is used instead, leaving it alone.\n", vm_knobs[i].m_name);
+			close(vm_knobs[i].m_fd);
+			vm_knobs[i].m_fd = -1;
+			continue;
+		}
+	}
+	
+	vm_state_load();
+	if (vm_state_save() == false) {
+		//a daemon that has been killed leaves the raised values behind
+		for (i=0; i<VM_KNOBS; i++) {
+			if ((vm_knobs[i].m_fd == -1) || (vm_knobs[i].m_normal != pm0_conf.m_vm_values[i])) continue;
+			log_msg(LOG_ERR, "vm.%s is already at its standby value %ld, and \'%s\' can't be written, laptop mode is off!\n",
+				vm_knobs[i].m_name, vm_knobs[i].m_normal, VM_STATE_FILE);
+			close_laptop_mode();
+			pm0_conf.m_laptop_mode = false;
+			return ALL_OK;
+		}
+	}
+	
+	for (i=0; i<VM_KNOBS; i++) {
+		if ((pm0_conf.m_verbose == true) && (vm_knobs[i].m_fd != -1) && (pm0_conf.m_vm_values[i] >= 0)) {
+			log_msg(LOG_INFO, "vm.%s is %ld, %ld while a drive is in standby.\n", vm_knobs[i].m_name, vm_knobs[i].m_normal, pm0_conf.m_vm_values[i]);
+		}
+	}
+	return ALL_OK;
+}
+
+//the values saved by a daemon that has died become the normal ones, and are put back right away
+bool vm_state_load(void) {
+	char name[VM_LENGTH];
+	long value;
+	FILE *state;
+	int i;
+	
+	if ((state = fopen(VM_STATE_FILE, "r")) == NULL) return false;
+	while (fscanf(state, "%31s %ld", name, &value) == 2) {
+		for (i=0; (i<VM_KNOBS) && (strcmp(name, vm_knobs[i].m_name) != 0); i++);
+		if ((i == VM_KNOBS) || (vm_knobs[i].m_fd == -1) || (value == vm_knobs[i].m_normal)) continue;
+		log_msg(LOG_NOTICE, "vm.%s is %ld, putting back %ld saved in \'%s\' by an earlier run.\n",
+			vm_knobs[i].m_name, vm_knobs[i].m_normal, value, VM_STATE_FILE);
+		if (vm_write(&vm_knobs[i], value) == true) vm_knobs[i].m_normal = value;
+	}
+	fclose(state);
+	return true;
+}
+
+bool vm_state_save(void) {
+	char buf[VM_KNOBS * (VM_LENGTH * 2)];
+	int fd, i, len = 0;
+	
+	for (i=0; i<VM_KNOBS; i++) {
+		if (vm_knobs[i].m_fd == -1) continue;
+		len += snprintf(buf + len, sizeof(buf) - len, "%s %ld\n", vm_knobs[i].m_name, vm_knobs[i].m_normal);
+	}
+	if ((unlink(VM_STATE_FILE) == -1) && (errno != ENOENT)) {
+		log_msg(LOG_WARNING, "unlink() failed on \'%s\': %s\n", VM_STATE_FILE, strerror(errno));
+		return false;
+	}
+	if ((fd = open(VM_STATE_FILE, O_CREAT | O_EXCL | O_NOFOLLOW | O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR)) == -1) {
+		log_msg(LOG_WARNING, "open() failed on \'%s\': %s\n", VM_STATE_FILE, strerror(errno));
+		return false;
+	}
+	if (write(fd, buf, len) != len) {
+		log_msg(LOG_WARNING, "write() failed on \'%s\': %s\n", VM_STATE_FILE, strerror(errno));
+		close(fd);
+		unlink(VM_STATE_FILE);
+		return false;
+	}
+	close(fd);
+	vm_state = true;
+	return true;
+}
+
+void close_laptop_mode(void) {
+	int i;
+	
+	laptop_restore();
+	//a failed restore leaves the file for the next start
+	if ((vm_state == true) && (vm_raised == false)) unlink(VM_STATE_FILE);
+	vm_state = false;
+	for (i=0; i<VM_KNOBS; i++) {
+		if (vm_knobs[i].m_fd != -1) {
+			close(vm_knobs[i].m_fd);
+			vm_knobs[i].m_fd = -1;
+		}
+	}
+}
+
+bool vm_read(vm_knob_t const *k, long *value) {
+	char buf[VM_LENGTH];
+	ssize_t len;
+	char *end;
+	
+	if ((len = pread(k->m_fd, buf, VM_LENGTH-1, 0)) <= 0) return false;
+	buf[len] = '\0';
+	*value = strtol(buf, &end, 10);
+	return (end != buf) ? true : false;
+}
+
+bool vm_write(vm_knob_t const *k, long value) {
+	char buf[VM_LENGTH];
+	int len = snprintf(buf, VM_LENGTH, "%ld\n", value);
+	
+	if (pwrite(k->m_fd, buf, len, 0) != len) {
+		log_msg(LOG_WARNING, "Setting vm.%s to %ld has failed: %s\n", k->m_name, value, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+//called for every standby, only the first one of a round does anything
+void laptop_raise(void) {
+	int i;
+	
+	if ((pm0_conf.m_laptop_mode == false) || (vm_raised == true)) return;
+	
+	for (i=0; i<VM_KNOBS; i++) {
+		if ((vm_knobs[i].m_fd == -1) || (pm0_conf.m_vm_values[i] < 0)) continue;
+		vm_write(&vm_knobs[i], pm0_conf.m_vm_values[i]);
+	}
+	vm_raised = true;
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Writeback settings raised for the standby.\n");
+	}
+}
+
+//one that could not be written back keeps vm_raised set, and is tried again next time
+void laptop_restore(void) {
+	bool ok = true;
+	int i;
+	
+	if (vm_raised == false) return;
+	
+	for (i=0; i<VM_KNOBS; i++) {
+		if ((vm_knobs[i].m_fd == -1) || (vm_knobs[i].m_normal < 0)) continue;
+		if (vm_write(&vm_knobs[i], vm_knobs[i].m_normal) == false) ok = false;
+	}
+	if (ok == false) return;
+	vm_raised = false;
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Writeback settings restored.\n");
+	}
+}
+
+//syncfs() waits for the writes, so it is done by a child, which is reaped through SIGCHLD
+void laptop_resumed(unsigned int woken) {
+	pid_t cp;
+	int i;
+	
+	if (vm_raised == false) return;
+	if (drives_asleep() == false) laptop_restore();
+	
+	for (i=0; (i<drive_mount_count) && ((woken & (1u << drive_mounts[i].m_drive)) == 0); i++);
+	if (i == drive_mount_count) return;
+	
+	if ((cp = fork()) == -1) {
+		log_msg(LOG_ERR, "fork() failed: %s\n", strerror(errno));
+		return;
+	}
+	if (cp > 0) return;
+	
+	for (i=0; i<drive_mount_count; i++) {
+		if ((woken & (1u << drive_mounts[i].m_drive)) != 0) syncfs(drive_mounts[i].m_fd);
+	}
+	_exit(ALL_OK);
+}
+
+#ifdef WITH_LIBCONFIG
+
+//	laptop_mode: { enabled = true; dirty_expire_centisecs = 60000; ... };
+int read_laptop_mode(config_t *source, conf_ptr_t target) {
+	char path[PATH_MAX];
+	int tmp_i, i;
+	
+	if (config_lookup_bool(source, "laptop_mode.enabled", &tmp_i) == CONFIG_TRUE) {
+		if (tmp_i == true) target->m_laptop_mode = true;
+	}
+	//-1 leaves the setting alone
+	for (i=0; i<VM_KNOBS; i++) {
+		snprintf(path, PATH_MAX, "laptop_mode.%s", vm_knobs[i].m_name);
+		if (config_lookup_int(source, path, &tmp_i) == CONFIG_TRUE) {
+			if (tmp_i < -1) {
+				fprintf(stderr, "The setting %s is below -1!\n", path);
+				return ERR_INVALID_ARG;
+			}
+			target->m_vm_values[i] = tmp_i;
+		}
+	}
+	return ALL_OK;
+}
+
+#endif //WITH_LIBCONFIG
+
+//=========== SPIN-UP ATTRIBUTION ==========
+
+/*
+While a drive is in standby, the file systems mounted from it are watched with fanotify,
+and the first processes to touch them are remembered, along with the first file each one
+touched. When the drive is seen to be active again, the report is logged, and kept for
+"pm0ctl wakeups". fanotify only sees access through the file systems, so a process that
+reads the block device itself (e.g. smartd) goes unnoticed. The mount points are those
+open_mounts() has found at startup, and only /proc is read when an access is recorded.
+*/
+int open_attribution(void) {
+	int fd;
+	
+	if (pm0_conf.m_attribution == false) return ALL_OK;
+	
+	if (drive_mount_count == 0) {
+		log_msg(LOG_WARNING, "None of the drives has a file system mounted, spin-ups won't be attributed.\n");
+		return ALL_OK;
+	}
+	
+	//a diagnostic, not worth refusing to start over
+	if ((fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE | O_CLOEXEC)) == -1) {
+		log_msg(LOG_WARNING, "fanotify_init() failed, spin-ups won't be attributed: %s\n", strerror(errno));
+		return ALL_OK;
+	}
+	
+	return ev_add(&ev_attr, fd, on_attr);
+}
+
+void close_attribution(void) {
+	attr_armed = 0;
+}
+
+//starts a new report when the drive goes to standby
+void attr_arm(int n) {
+	int i;
+	
+	if ((ev_attr.m_fd == -1) || ((attr_armed & (1u << n)) != 0)) return;
+	
+	memset(&attr_pending[n], 0, sizeof(wake_report_t));
+	for (i=0; i<drive_mount_count; i++) {
+		if (drive_mounts[i].m_drive != n) continue;
+		if (fanotify_mark(ev_attr.m_fd, FAN_MARK_ADD | FAN_MARK_MOUNT, ATTR_EVENTS, drive_mounts[i].m_fd, NULL) == -1) {
+			log_msg(LOG_WARNING, "fanotify_mark() failed for HDD-%d: %s\n", n, strerror(errno));
+		}
+	}
+	attr_armed |= (1u << n);
+}
+
+void attr_disarm(int n) {
+	int i;
+	
+	if ((attr_armed & (1u << n)) == 0) return;
+	
+	for (i=0; i<drive_mount_count; i++) {
+		if (drive_mounts[i].m_drive == n) {
+			fanotify_mark(ev_attr.m_fd, FAN_MARK_REMOVE | FAN_MARK_MOUNT, ATTR_EVENTS, drive_mounts[i].m_fd, NULL);
+		}
+	}
+	attr_armed &= ~(1u << n);
+}
+
+//counts the access against its process, which is added to the report if it is new and there is room
+void attr_record(int n, struct fanotify_event_metadata const *ev, struct timespec const *now) {
+	wake_report_t *r = &attr_pending[n];
+	culprit_t *c;
+	char path[PATH_MAX];
+	ssize_t len;
+	int i, fd;
+	
+	for (i=0; i<r->m_count; i++) {
+		if (r->m_culprits[i].m_pid == ev->pid) {
+			r->m_culprits[i].m_accesses++;
+			return;
+		}
+	}
+	if (r->m_count == ATTR_CULPRITS) return;
+	
+	c = &r->m_culprits[r->m_count++];
+	c->m_pid = ev->pid;
+	c->m_accesses = 1;
+	c->m_after = elapsed_ms(&drives[n].m_standby_at, now) / 1000;
+	
+	//the process may be gone by now
+	strcpy(c->m_comm, "?");
+	snprintf(path, PATH_MAX, "/proc/%d/comm", (int) ev->pid);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) != -1) {
+		if ((len = read(fd, c->m_comm, sizeof(c->m_comm) - 1)) > 0) {
+			c->m_comm[len] = '\0';
+			c->m_comm[strcspn(c->m_comm, "\n")] = '\0';
+		}
+		close(fd);
+	}
+	
+	strcpy(c->m_path, "?");
+	snprintf(path, PATH_MAX, "/proc/self/fd/%d", ev->fd);
+	if ((len = readlink(path, c->m_path, ATTR_PATH_LENGTH - 1)) > 0) c->m_path[len] = '\0';
+}
+
+//closes the report of a drive that has just been seen waking up, and logs it
+void attr_report(int n, unsigned long gap) {
+	culprit_t const *c;
+	int i;
+	
+	if ((attr_armed & (1u << n)) == 0) return;
+	
+	//accesses still queued happened before we noticed the spin-up
+	on_attr(&ev_attr);
+	attr_disarm(n);
+	
+	attr_reports[n] = attr_pending[n];
+	attr_reports[n].m_when = time(NULL);
+	attr_reports[n].m_standby = gap;
+	
+	if (attr_reports[n].m_count == 0) {
+		log_msg(LOG_NOTICE, "HDD-%d woke up after %lu s in standby, without its file systems being touched.\n", n, gap);
+		return;
+	}
+	log_msg(LOG_NOTICE, "HDD-%d woke up after %lu s in standby, its file systems were touched by:\n", n, gap);
+	for (i=0; i<attr_reports[n].m_count; i++) {
+		c = &attr_reports[n].m_culprits[i];
+		log_msg(LOG_NOTICE, "  %d. %s[%d] %lu s into standby, %lu access(es), first to \'%s\'\n",
+			i+1, c->m_comm, (int) c->m_pid, c->m_after, c->m_accesses, c->m_path);
+	}
+}
+
+void on_attr(ev_source_t *src) {
+	struct fanotify_event_metadata buf[ATTR_BUF_LENGTH / sizeof(struct fanotify_event_metadata)];
+	struct fanotify_event_metadata *ev;
+	struct timespec now;
+	struct stat st;
+	ssize_t len;
+	pid_t self = getpid();
+	int i, n;
+	
+	if (src->m_fd == -1) return;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	while ((len = read(src->m_fd, buf, sizeof(buf))) > 0) {
+		for (ev = buf; FAN_EVENT_OK(ev, len); ev = FAN_EVENT_NEXT(ev, len)) {
+			//no descriptor comes with a queue overflow
+			if (ev->fd < 0) continue;
+			
+			n = -1;
+			if ((ev->pid != self) && (fstat(ev->fd, &st) == 0)) {
+				for (i=0; i<drive_mount_count; i++) {
+					if (drive_mounts[i].m_dev == st.st_dev) {
+						n = drive_mounts[i].m_drive;
+						break;
+					}
+				}
+			}
+			//events of a drive that has just been disarmed may still be queued
+			if ((n != -1) && ((attr_armed & (1u << n)) != 0)) attr_record(n, ev, &now);
+			close(ev->fd);
+		}
+	}
+}
+
+//=========== JOURNAL ==========
+
+/*
+Every event is written to a ring of fixed-width records (see pm0.h) in a file on tmpfs,
+which is kept mapped, so recording one takes no system call: the clocks are read through
+the vDSO. A journal left behind by an earlier run is carried on, if its layout matches.
+Without the file, the daemon runs on without a journal.
+*/
+int open_journal(void) {
+	char const *path = (pm0_conf.m_journal_file != NULL) ? pm0_conf.m_journal_file : JOURNAL_FILE;
+	struct stat st;
+	void *map;
+	
+	if ((strlen(path) == 0) || (pm0_conf.m_journal_records == 0)) return ALL_OK;//disabled
+	
+	journal_length = sizeof(journal_head_t) + pm0_conf.m_journal_records * sizeof(journal_rec_t);
+	if ((journal_fd = open(path, O_CREAT | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
+		log_msg(LOG_WARNING, "open() failed on \'%s\', events won't be journalled: %s\n", path, strerror(errno));
+		return ALL_OK;
+	}
+	if ((fstat(journal_fd, &st) == -1) || ((st.st_size != (off_t) journal_length) && (ftruncate(journal_fd, journal_length) == -1)) ||
+		((map = mmap(NULL, journal_length, PROT_READ | PROT_WRITE, MAP_SHARED, journal_fd, 0)) == MAP_FAILED)) {
+		log_msg(LOG_WARNING, "Setting up \'%s\' failed, events won't be journalled: %s\n", path, strerror(errno));
+		close(journal_fd);
+		journal_fd = -1;
+		return ALL_OK;
+	}
+	
+	journal = (journal_head_t *) map;
+	journal_recs = (journal_rec_t *) (journal + 1);
+	if ((st.st_size != (off_t) journal_length) || (journal->m_magic != JOURNAL_MAGIC) || (journal->m_version != JOURNAL_VERSION) ||
+		(journal->m_record_size != sizeof(journal_rec_t)) || (journal->m_records != pm0_conf.m_journal_records)) {
+		memset(map, 0, journal_length);
+		journal->m_magic = JOURNAL_MAGIC;
+		journal->m_version = JOURNAL_VERSION;
+		journal->m_record_size = sizeof(journal_rec_t);
+		journal->m_records = pm0_conf.m_journal_records;
+	}
+	journal->m_pid = getpid();
+	
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Journalling events to \'%s\', the last %lu are kept.\n", path, pm0_conf.m_journal_records);
+	}
+	return ALL_OK;
+}
+
+void close_journal(void) {
+	if (journal != NULL) {
+		journal->m_pid = 0;
+		munmap(journal, journal_length);
+		journal = NULL;
+		journal_recs = NULL;
+	}
+	if (journal_fd != -1) {
+		close(journal_fd);
+		journal_fd = -1;
+	}
+}
+
+//the record is invalidated first, and validated again last, for readers copying it meanwhile
+void journal_write(int type, unsigned int drives_mask, pid_t pid, int status, unsigned long duration_ms) {
+	struct timespec now;
+	journal_rec_t *r;
+	uint64_t seq;
+	
+	if (journal == NULL) return;
+	
+	seq = journal->m_written + 1;
+	r = &journal_recs[(seq - 1) % journal->m_records];
+	r->m_seq = 0;
+	__sync_synchronize();
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	r->m_mono_ns = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+	r->m_time = time(NULL);
+	r->m_pid = pid;
+	r->m_status = status;
+	r->m_duration_ms = duration_ms;
+	r->m_drives = drives_mask;
+	r->m_type = type;
+	r->m_reserved = 0;
+	
+	__sync_synchronize();
+	r->m_seq = seq;
+	journal->m_written = seq;
+}
+
+//=========== HOT SET ==========
+
+/*
+Small files that are read all the time (indexes, thumbnails, share metadata) wake a
+sleeping drive as soon as the page cache lets go of them. The files matching the globs
+in hotset.paths are mapped and locked in memory, up to hotset.budget KiB, so that reading
+them is served from RAM while the drive sleeps. Looking the files up touches the drives,
+so the set is only refreshed (every hotset.refresh seconds) while none of them is in
+standby, and is left frozen as it is otherwise.
+*/
+int open_hotset(void) {
+	int i;
+	
+	if (pm0_conf.m_hot_paths == NULL) {
+		//a reload may have emptied the hot set
+		release_hotset();
+		if (ev_hotset.m_fd != -1) ev_arm(&ev_hotset, 0, 0);
+		return ALL_OK;
+	}
+	
+	if ((ev_hotset.m_fd == -1) && ((i = ev_add(&ev_hotset, timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), on_hotset)) != ALL_OK)) return i;
+	
+	hot_refresh();
+	return ev_arm(&ev_hotset, pm0_conf.m_hot_refresh * 1000, pm0_conf.m_hot_refresh * 1000);
+}
+
+//unlocking leaves the pages in the page cache, so a refresh maps most of them straight back
+void release_hotset(void) {
+	int i;
+	
+	for (i=0; i<hot_count; i++) munmap(hot_files[i].m_map, hot_files[i].m_length);
+	hot_count = 0;
+	hot_bytes = 0;
+}
+
+void hot_refresh(void) {
+	unsigned long long budget = (unsigned long long) pm0_conf.m_hot_budget * 1024;
+	int old_count = hot_count, skipped = 0, unlocked = 0;
+	unsigned long long old_bytes = hot_bytes;
+	glob_t found;
+	size_t j;
+	int i;
+	
+	if ((pm0_conf.m_hot_paths == NULL) || (drives_asleep() == true)) return;
+	
+	release_hotset();
+	//glob() allocates, the one allocation after startup, and only while all the drives are up
+	for (i=0; pm0_conf.m_hot_paths[i] != NULL; i++) {
+		if (glob(pm0_conf.m_hot_paths[i], 0, NULL, &found) != 0) continue;
+		for (j=0; j<found.gl_pathc; j++) {
+			if (hot_add(found.gl_pathv[j], budget) == false) skipped++;
+		}
+		globfree(&found);
+	}
+	for (i=0; i<hot_count; i++) {
+		if (hot_files[i].m_locked == false) unlocked++;
+	}
+	
+	if ((hot_count != old_count) || (hot_bytes != old_bytes)) {
+		log_msg(LOG_NOTICE, "Hot set: %d file(s), %llu KiB held in memory, %d file(s) left out over the budget.\n",
+			hot_count, hot_bytes / 1024, skipped);
+		if (unlocked > 0) {
+			log_msg(LOG_WARNING, "%d file(s) of the hot set could not be locked, they may still be evicted.\n", unlocked);
+		}
+		metrics_dirty = true;
+	}
+}
+
+//maps a regular file if it fits in the budget, false if it doesn't
+bool hot_add(char const *path, unsigned long long budget) {
+	struct stat st;
+	void *map;
+	int fd;
+	
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) return true;
+	if ((fstat(fd, &st) == -1) || (S_ISREG(st.st_mode) == 0) || (st.st_size == 0)) {
+		close(fd);
+		return true;
+	}
+	if ((hot_count == HOT_FILES) || (hot_bytes + (unsigned long long) st.st_size > budget)) {
+		close(fd);
+		return false;
+	}
+	
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		log_msg(LOG_WARNING, "mmap() failed on \'%s\': %s\n", path, strerror(errno));
+		return true;
+	}
+	
+	hot_files[hot_count].m_map = map;
+	hot_files[hot_count].m_length = st.st_size;
+	//without the lock (RLIMIT_MEMLOCK), the pages are at least read in now
+	if ((hot_files[hot_count].m_locked = (mlock(map, st.st_size) == 0) ? true : false) == false) {
+		madvise(map, st.st_size, MADV_WILLNEED);
+	}
+	hot_bytes += st.st_size;
+	hot_count++;
+	return true;
+}
+
+void on_hotset(ev_source_t *src) {
+	if (ev_expired(src) == true) hot_refresh();
+}
+
+//=========== ADAPTIVE TIMEOUT ==========
+
+/*
+A standby of g seconds saves g - adaptive.breakeven seconds worth of power, a short one
+costs a spin-up (and its 8-10 s of latency) for less than that. Every standby adds the
+idle period it ended (the timeout plus g) to the history of its drive. A timeout of t
+would have put the drive to sleep in each recorded period longer than t, for that
+period minus t; the timeout (in whole minutes, within the configured bounds) with the
+largest net saving over the history of all the drives, which share it, is the one to
+use. Moving to it is gradual, as a few periods say little, and those shorter than the
+current timeout never end in a standby, so nothing is known about them: the timeout is
+at most doubled, or lowered by one minute, per standby. It is only re-issued to the
+backend when it actually changes.
+*/
+void adapt_timeout(int n, unsigned long gap) {
+	unsigned long timeout, goal, t, idle;
+	long long saving, best = 0;
+	unsigned long i, count;
+	decision_t *d;
+	int j;
+	
+	//a scheduled window owns the timeout while it is open
+	if (windows_active > 0) return;
+	
+	drives[n].m_idle[drives[n].m_idle_count % ADAPT_IDLE_HISTORY] = pm0_conf.m_timeout * 60 + gap;
+	drives[n].m_idle_count++;
+	
+	//the longest timeout wins a tie, as it spins the drives up the least
+	goal = pm0_conf.m_max_timeout;
+	for (t=pm0_conf.m_max_timeout; t>=pm0_conf.m_min_timeout; t--) {
+		saving = 0;
+		for (j=0; j<pm0_conf.m_drive_count; j++) {
+			count = (drives[j].m_idle_count < ADAPT_IDLE_HISTORY) ? drives[j].m_idle_count : ADAPT_IDLE_HISTORY;
+			for (i=0; i<count; i++) {
+				idle = drives[j].m_idle[i];
+				if (idle > t * 60) saving += (long long) (idle - t * 60) - (long long) pm0_conf.m_breakeven;
+			}
+		}
+		if (saving > best) {
+			best = saving;
+			goal = t;
+		}
+		if (t == 0) break;
+	}
+	timeout = goal;
+	if ((goal > pm0_conf.m_timeout * 2) && (pm0_conf.m_timeout > 0)) timeout = pm0_conf.m_timeout * 2;
+	else if (goal + 1 < pm0_conf.m_timeout) timeout = pm0_conf.m_timeout - 1;
+	
+	if (timeout > pm0_conf.m_max_timeout) timeout = pm0_conf.m_max_timeout;
+	if (timeout < pm0_conf.m_min_timeout) timeout = pm0_conf.m_min_timeout;
+	
+	d = &decisions[decision_count % ADAPT_HISTORY];
+	d->m_when = time(NULL);
+	d->m_drive = n;
+	d->m_gap = gap;
+	d->m_old_timeout = pm0_conf.m_timeout;
+	d->m_new_timeout = timeout;
+	decision_count++;
+	
+	log_msg(LOG_NOTICE, "HDD-%d was in standby for %lu s (break-even %lu s, best timeout %lu minute(s) so far), timeout %lu -> %lu minute(s).\n",
+		n, gap, pm0_conf.m_breakeven, goal, pm0_conf.m_timeout, timeout);
+	
+	if (timeout == pm0_conf.m_timeout) return;
+	if (pm0_conf.m_backend->m_set_idletime(timeout) != ALL_OK) {
+		d->m_new_timeout = pm0_conf.m_timeout;
+		return;
+	}
+	pm0_conf.m_timeout = timeout;
+}
+
+//=========== RESIDENT MODE ==========
+
+/*
+Copies the file named by *path into the staging directory, maps the copy and
+points *path to it. Files on tmpfs live in the page cache only, and the mapping
+keeps them locked there once mlockall() has run.
+*/
+int stage_file(conf_ptr_t p_conf, char **path, int n) {
+	char buf[COPY_BUF_LENGTH];
+	char base_src[PATH_MAX];
+	char const *dir = (pm0_conf.m_staging_dir != NULL) ? pm0_conf.m_staging_dir : STAGING_DIR;
+	char *staged_path;
+	struct stat stat_buf;
+	ssize_t r;
+	int src, dst, len;
+	
+	if (staged_count == MAX_STAGED) {
+		log_msg(LOG_ERR, "More than %d files to stage, \'%s\' is one too many!\n", MAX_STAGED, *path);
+		return ERR_STAGE_FAIL;
+	}
+	strncpy(base_src, *path, PATH_MAX - 1);
+	base_src[PATH_MAX - 1] = '\0';
+	len = strlen(dir) + strlen(basename(base_src)) + 16;
+	//the copy belongs to the configuration, drop_staged() is called before the arena goes
+	if ((staged_path = (char *) arena_alloc(p_conf, len)) == NULL) {
+		log_msg(LOG_ERR, "arena_alloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	snprintf(staged_path, len, "%s/%d-%s", dir, n, basename(base_src));
+	
+	if ((src = open(*path, O_RDONLY)) == -1) {
+		log_msg(LOG_ERR, "open() failed on \'%s\': %s\n", *path, strerror(errno));
+		return ERR_STAGE_FAIL;
+	}
+	if (fstat(src, &stat_buf) == -1) {
+		log_msg(LOG_ERR, "fstat() failed on '%s': %s\n", *path, strerror(errno));
+		close(src);
+		return ERR_STAGE_FAIL;
+	}
+	//a stale copy (of a daemon that was killed) is replaced, anything else in the way is an error
+	if ((unlink(staged_path) == -1) && (errno != ENOENT)) {
+		log_msg(LOG_ERR, "unlink() failed on \'%s\': %s\n", staged_path, strerror(errno));
+		close(src);
+		return ERR_STAGE_FAIL;
+	}
+	if ((dst = open(staged_path, O_CREAT | O_EXCL | O_NOFOLLOW | O_WRONLY | O_CLOEXEC, stat_buf.st_mode & 07777)) == -1) {
+		log_msg(LOG_ERR, "open() failed on \'%s\': %s\n", staged_path, strerror(errno));
+		close(src);
+		return ERR_STAGE_FAIL;
+	}
+	
+	while ((r = read(src, buf, COPY_BUF_LENGTH)) > 0) {
+		if (write(dst, buf, r) != r) {
+			r = -1;
+			break;
+		}
+	}
+	close(src);
+	if (r == -1) {
+		log_msg(LOG_ERR, "Copying \'%s\' to \'%s\' failed: %s\n", *path, staged_path, strerror(errno));
+		close(dst);
+		unlink(staged_path);
+		return ERR_STAGE_FAIL;
+	}
+	
+	//a writable descriptor or mapping of the copy would make exec() fail with ETXTBSY
+	close(dst);
+	if ((dst = open(staged_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) == -1) {
+		log_msg(LOG_ERR, "open() failed on '%s': %s\n", staged_path, strerror(errno));
+		unlink(staged_path);
+		return ERR_STAGE_FAIL;
+	}
+	
+	staged_files[staged_count].m_path = staged_path;
+	staged_files[staged_count].m_length = stat_buf.st_size;
+	staged_files[staged_count].m_map = NULL;
+	if (stat_buf.st_size > 0) {
+		if ((staged_files[staged_count].m_map = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED, dst, 0)) == MAP_FAILED) {
+			staged_files[staged_count].m_map = NULL;
+			log_msg(LOG_WARNING, "mmap() failed on \'%s\': %s\n", staged_path, strerror(errno));
+		}
+	}
+	close(dst);
+	staged_count++;
+	
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Staged \'%s\' as \'%s\'.\n", *path, staged_path);
+	}
+	
+	//the old path stays in the arena
+	*path = staged_path;
+	return ALL_OK;
+}
+
+//the hooks themselves, and every argument naming a regular file (the scripts they run) go to tmpfs
+int stage_hooks(conf_ptr_t p_conf) {
+	char const *dir = (pm0_conf.m_staging_dir != NULL) ? pm0_conf.m_staging_dir : STAGING_DIR;
+	struct stat stat_buf;
+	hook_t *h;
+	int i, j, ret;
+	
+	if (p_conf->m_hook_count == 0) return ALL_OK;
+	
+	if ((mkdir(dir, S_IRWXU) == -1) && (errno != EEXIST)) {
+		log_msg(LOG_ERR, "mkdir() failed on \'%s\': %s\n", dir, strerror(errno));
+		return ERR_STAGE_FAIL;
+	}
+	//the default lives in a world-writable directory, one found there must be the daemon's own
+	if (lstat(dir, &stat_buf) == -1) {
+		log_msg(LOG_ERR, "lstat() failed on \'%s\': %s\n", dir, strerror(errno));
+		return ERR_STAGE_FAIL;
+	}
+	if ((S_ISDIR(stat_buf.st_mode) == 0) || (stat_buf.st_uid != geteuid()) || ((stat_buf.st_mode & 07777) != S_IRWXU)) {
+		log_msg(LOG_ERR, "\'%s\' is not a directory owned by UID %d with mode 0700, refusing to stage the hooks there!\n", dir, (int) geteuid());
+		return ERR_STAGE_FAIL;
+	}
+	
+	for (j=0; j<p_conf->m_hook_count; j++) {
+		h = &p_conf->m_hooks[j];
+		if ((ret = stage_file(p_conf, &h->m_exec, staged_serial++)) != ALL_OK) return ret;
+		
+		for (i=1; h->m_args[i] != NULL; i++) {
+			if ((stat(h->m_args[i], &stat_buf) == 0) && ((stat_buf.st_mode & S_IFMT) == S_IFREG)) {
+				if ((ret = stage_file(p_conf, &h->m_args[i], staged_serial++)) != ALL_OK) return ret;
+			}
+		}
+	}
+	return ALL_OK;
+}
+
+//removes the staged files first..last-1, the hooks of a configuration that has been replaced or rejected
+void drop_staged(int first, int last) {
+	int i;
+	
+	if (first >= last) return;
+	
+	for (i=first; i<last; i++) {
+		if (staged_files[i].m_map != NULL) munmap(staged_files[i].m_map, staged_files[i].m_length);
+		unlink(staged_files[i].m_path);
+	}
+	memmove(&staged_files[first], &staged_files[last], (staged_count - last) * sizeof(staged_t));
+	staged_count -= last - first;
+}
+
+void unstage_hooks(void) {
+	char const *dir = (pm0_conf.m_staging_dir != NULL) ? pm0_conf.m_staging_dir : STAGING_DIR;
+	
+	if (staged_count == 0) return;
+	
+	drop_staged(0, staged_count);
+	rmdir(dir);
+}
+
+//VmLck of the running process, as the kernel accounts it
+unsigned long locked_bytes(void) {
+	char line[128];
+	unsigned long kb = 0;
+	FILE *status;
+	
+	if ((status = fopen(PROC_STATUS, "r")) == NULL) return 0;
+	while (fgets(line, sizeof(line), status) != NULL) {
+		if (sscanf(line, "VmLck: %lu kB", &kb) == 1) break;
+	}
+	fclose(status);
+	return kb * 1024;
+}
+
+int go_resident(void) {
+	int ret;
+	
+	if ((ret = stage_hooks(&pm0_conf)) != ALL_OK) return ret;
+	
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+		log_msg(LOG_ERR, "mlockall() failed: %s\n", strerror(errno));
+		return ERR_MLOCK_FAIL;
+	}
+	
+	log_msg(LOG_NOTICE, "Resident mode: %lu bytes locked in memory, %d hook file(s) staged.\n", locked_bytes(), staged_count);
+	return ALL_OK;
+}
+
+//file systems whose contents never come from a drive
+bool on_ramfs(struct statfs const *fs) {
+	switch (fs->f_type) {
+		case TMPFS_MAGIC:
+		case RAMFS_MAGIC:
+		case SYSFS_MAGIC:
+		case PROC_SUPER_MAGIC:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+Strict mode makes sure, once everything is set up, that handling a standby event can't
+touch a drive: the hook, the files staged for it and the metrics file all have to be on
+a memory file system. The daemon itself only uses descriptors and sockets opened at
+startup from then on, so it refuses what would need a path: max_processes (a scan of
+/proc), attribution (/proc for every process it records) and the hot set (a glob() on
+every refresh). The PID file is only removed on exit, and a reload reads the new
+configuration; it checks its hooks, and the files staged for them from first on.
+*/
+int check_strict(conf_cptr_t p_conf, int first) {
+	struct statfs fs;
+	int i;
+	
+	if (pm0_conf.m_attribution == true) {
+		log_msg(LOG_ERR, "Strict mode: attribution reads /proc, it can't be used!\n");
+		return ERR_STRICT;
+	}
+	if (p_conf->m_hot_paths != NULL) {
+		log_msg(LOG_ERR, "Strict mode: the hot set is looked up by path, it can't be used!\n");
+		return ERR_STRICT;
+	}
+	for (i=0; i<p_conf->m_hook_count; i++) {
+		if (p_conf->m_hooks[i].m_max_procs > 0) {
+			log_msg(LOG_ERR, "Strict mode: \'%s\' has max_processes, which scans /proc, it can't be used!\n", p_conf->m_hooks[i].m_exec);
+			return ERR_STRICT;
+		}
+	}
+	for (i=0; i<p_conf->m_hook_count; i++) {
+		if ((fstatfs(p_conf->m_hooks[i].m_fd, &fs) == -1) || (on_ramfs(&fs) == false)) {
+			log_msg(LOG_ERR, "Strict mode: \'%s\' is not on a memory file system!\n", p_conf->m_hooks[i].m_exec);
+			return ERR_STRICT;
+		}
+	}
+	for (i=first; i<staged_count; i++) {
+		if ((statfs(staged_files[i].m_path, &fs) == -1) || (on_ramfs(&fs) == false)) {
+			log_msg(LOG_ERR, "Strict mode: \'%s\' is not on a memory file system!\n", staged_files[i].m_path);
+			return ERR_STRICT;
+		}
+	}
+	if ((stats_fd != -1) && ((fstatfs(stats_fd, &fs) == -1) || (on_ramfs(&fs) == false))) {
+		log_msg(LOG_ERR, "Strict mode: \'%s\' is not on a memory file system!\n", STATS_FILE);
+		return ERR_STRICT;
+	}
+	if ((metrics_dir != -1) && ((fstatfs(metrics_dir, &fs) == -1) || (on_ramfs(&fs) == false))) {
+		log_msg(LOG_ERR, "Strict mode: \'%s\' is not on a memory file system!\n", pm0_conf.m_metrics_file);
+		return ERR_STRICT;
+	}
+	if ((journal != NULL) && ((fstatfs(journal_fd, &fs) == -1) || (on_ramfs(&fs) == false))) {
+		log_msg(LOG_ERR, "Strict mode: \'%s\' is not on a memory file system!\n", (pm0_conf.m_journal_file != NULL) ? pm0_conf.m_journal_file : JOURNAL_FILE);
+		return ERR_STRICT;
+	}
+	
+	log_msg(LOG_NOTICE, "Strict mode: standby events will be handled without file system access.\n");
+	return ALL_OK;
+}
+
+//=========== BACKENDS ==========
+
+backend_t const backends[] = {
+		{ "dns313", dns313_open, dns313_register_pid, dns313_set_idletime, sl_pwr_event_signals, sl_pwr_drive_of, dns313_close },
+		{ "sim", sim_open, sim_register_pid, sim_set_idletime, sl_pwr_event_signals, sl_pwr_drive_of, sim_close },
+		{ "diskstats", stats_open, stats_register_pid, stats_set_idletime, sl_pwr_event_signals, sl_pwr_drive_of, stats_close },
+		{ NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+	};
+
+backend_t const *find_backend(char const *name) {
+	int i;
+	
+	for (i=0; backends[i].m_name != NULL; i++) {
+		if (strcmp(backends[i].m_name, name) == 0) return &backends[i];
+	}
+	return NULL;
+}
+
+/*
+The sl_pwr driver signals the registered PID: SIGUSR1 means HDD-1, SIGUSR2 means HDD-0.
+A driver with more bays queues RT_STANDBY with the index of the drive in si_value
+(as sigqueue() would), and real-time signals queue up, so none of a burst is lost.
+*/
+void sl_pwr_event_signals(sigset_t *set) {
+	sigaddset(set, SIGUSR1);
+	sigaddset(set, SIGUSR2);
+	sigaddset(set, RT_STANDBY);
+}
+
+int sl_pwr_drive_of(struct signalfd_siginfo const *info) {
+	if ((int) info->ssi_signo == RT_STANDBY) {
+		if ((info->ssi_int >= 0) && (info->ssi_int < pm0_conf.m_drive_count)) return info->ssi_int;
+		log_msg(LOG_WARNING, "Standby event of unknown drive %d, ignoring it.\n", info->ssi_int);
+		return -1;
+	}
+	switch (info->ssi_signo) {
+		case SIGUSR1:
+			return 1;
+		case SIGUSR2:
+			return 0;
+		default:
+			return -1;
+	}
+}
+
+int dns313_open(void) {
+	struct stat buf;
+	
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Checking and opening device file \'%s\'.\n", DEV_FILE);
+	}
+	
+	if (stat(DEV_FILE, &buf) == -1) {
+		log_msg(LOG_ERR, "stat() failed on \'%s\': %s\n", DEV_FILE, strerror(errno));
+		return ERR_STAT_OTHER;
+	}
+	else {
+		if ((buf.st_mode & S_IFMT) != S_IFCHR) {
+			log_msg(LOG_ERR, "\'%s\' is not a character device!\n", DEV_FILE);
+			return ERR_DEV_FILE;
+		}
+	}
+	
+	//kept open until exit, so the hooks must not inherit it
+	if ((dev_fd = open(DEV_FILE, O_NONBLOCK | O_CLOEXEC)) == -1) {
+		log_msg(LOG_ERR, "open() failed on \'%s\': %s\n", DEV_FILE, strerror(errno));
+		return ERR_OPEN_FAIL;
+	}
+	return ALL_OK;
+}
+
+int dns313_register_pid(unsigned long d_pid) {
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Registering %s power management daemon in kernel.\n", EXEC_NAME);
+	}
+	
+	if (ioctl(dev_fd, IOCTL_PM0_REGISTER_PID, &d_pid) == -1) {
+		log_msg(LOG_ERR, "IOCTL_PM0_REGISTER_PID failed: %s\n", strerror(errno));
+		return ERR_IOCTL_PID;
+	}
+	return ALL_OK;
+}
+
+int dns313_set_idletime(unsigned long timeout) {
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Setting suspend timeout for hard disks to %lu minute(s).\n", timeout);
+	}
+	
+	if (ioctl(dev_fd, IOCTL_PM0_SET_IDLETIME, timeout) == -1) {
+		log_msg(LOG_ERR, "IOCTL_PM0_SET_IDLETIME failed: %s\n", strerror(errno));
+		return ERR_IOCTL_TIMEOUT;
+	}
+	return ALL_OK;
+}
+
+void dns313_close(void) {
+	if (dev_fd != -1) {
+		close_file(dev_fd, DEV_FILE);
+		dev_fd = -1;
+	}
+}
+
+/*
+The simulator stands in for the sl_pwr driver on ordinary Linux boxes. Every drive gets
+a POSIX timer that raises the drive's standby signal at a fixed interval, so runs are
+deterministic and the event rate is known in advance. An interval of 0 disables the drive,
+which leaves it to an outside process to send SIGUSR1/SIGUSR2 to the daemon.
+*/
+int sim_open(void) {
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Using the simulated power management device.\n");
+	}
+	return ALL_OK;
+}
+
+int sim_register_pid(unsigned long d_pid) {
+	struct sigevent sev;
+	struct itimerspec its;
+	int i;
+	
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_SIGNAL;
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		//the first two drives as the DNS-313 does it, the others as a bigger enclosure would
+		sev.sigev_signo = (i == 0) ? SIGUSR2 : ((i == 1) ? SIGUSR1 : RT_STANDBY);
+		sev.sigev_value.sival_int = i;
+		if (timer_create(CLOCK_MONOTONIC, &sev, &sim_timers[i]) == -1) {
+			log_msg(LOG_ERR, "timer_create() failed: %s\n", strerror(errno));
+			while (i-- > 0) timer_delete(sim_timers[i]);
+			return ERR_TIMER_FAIL;
+		}
+	}
+	sim_armed = true;
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if (pm0_conf.m_verbose == true) {
+			log_msg(LOG_INFO, "Simulating a standby event on HDD-%d every %lu ms.\n", i, pm0_conf.m_sim_interval[i]);
+		}
+		its.it_value.tv_sec = pm0_conf.m_sim_interval[i] / 1000;
+		its.it_value.tv_nsec = (pm0_conf.m_sim_interval[i] % 1000) * 1000000;
+		its.it_interval = its.it_value;
+		if (timer_settime(sim_timers[i], 0, &its, NULL) == -1) {
+			log_msg(LOG_ERR, "timer_settime() failed: %s\n", strerror(errno));
+			return ERR_TIMER_FAIL;
+		}
+	}
+	return ALL_OK;
+}
+
+//the event rate of the simulator does not depend on the timeout
+int sim_set_idletime(unsigned long timeout) {
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Simulated suspend timeout set to %lu minute(s).\n", timeout);
+	}
+	return ALL_OK;
+}
+
+void sim_close(void) {
+	int i;
+	
+	if (sim_armed == true) {
+		for (i=0; i<pm0_conf.m_drive_count; i++) timer_delete(sim_timers[i]);
+		sim_armed = false;
+	}
+}
+
+/*
+The diskstats backend does in userspace what the sl_pwr driver does in the kernel, for
+any block device: a drive whose I/O counters in diskstats have not moved for the idle
+time is put in standby, and its standby event is queued to the daemon, just like a
+driver of more than two drives would do it. diskstats is read through a descriptor
+kept open, into a buffer allocated once, so a tick costs a pread() and a scan.
+*/
+int stats_open(void) {
+	char path[PATH_MAX];
+	int i;
+	
+	for (i=0; i<MAX_DRIVES; i++) {
+		memset(&stats_drives[i], 0, sizeof(stats_drive_t));
+		stats_drives[i].m_dev_fd = -1;
+	}
+	
+	snprintf(path, PATH_MAX, "%s/%s", (pm0_conf.m_stats_root != NULL) ? pm0_conf.m_stats_root : proc_root(), STATS_FILE);
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Tracking the idle time of the drives through '%s'.\n", path);
+	}
+	
+	if ((stats_fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+		log_msg(LOG_ERR, "open() failed on '%s': %s\n", path, strerror(errno));
+		return ERR_OPEN_FAIL;
+	}
+	if ((stats_buf = (char *) calloc(STATS_LENGTH, sizeof(char))) == NULL) {
+		log_msg(LOG_ERR, "calloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	
+	for (i=0; (i<pm0_conf.m_drive_count) && (pm0_conf.m_spindown == true); i++) {
+		snprintf(path, PATH_MAX, "%s/%s", DEV_ROOT, drives[i].m_dev);
+		if ((stats_drives[i].m_dev_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) == -1) {
+			log_msg(LOG_WARNING, "open() failed on '%s', HDD-%d won't be put in standby: %s\n", path, i, strerror(errno));
+		}
+	}
+	return ALL_OK;
+}
+
+//the PID to queue the standby events to, and a first read of the counters
+int stats_register_pid(unsigned long d_pid) {
+	struct timespec now;
+	int i;
+	
+	stats_pid = (pid_t) d_pid;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (stats_read(&now) == false) {
+		log_msg(LOG_ERR, "Reading the I/O counters of the drives has failed!\n");
+		return ERR_STATS;
+	}
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if (stats_drives[i].m_seen == false) {
+			log_msg(LOG_WARNING, "HDD-%d (%s) is not in diskstats, its idle time can't be tracked.\n", i, drives[i].m_dev);
+		}
+	}
+	
+	if (((i = ev_add(&ev_stats, timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), on_stats)) != ALL_OK) ||
+		((i = ev_arm(&ev_stats, pm0_conf.m_stats_interval * 1000, pm0_conf.m_stats_interval * 1000)) != ALL_OK)) {
+		return i;
+	}
+	return ALL_OK;
+}
+
+int stats_set_idletime(unsigned long timeout) {
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Idle time of the drives set to %lu minute(s).\n", timeout);
+	}
+	stats_timeout = timeout;
+	return ALL_OK;
+}
+
+void stats_close(void) {
+	int i;
+	
+	if (stats_fd == -1) return;
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if (stats_drives[i].m_dev_fd != -1) {
+			close(stats_drives[i].m_dev_fd);
+			stats_drives[i].m_dev_fd = -1;
+		}
+	}
+	if (stats_fd != -1) {
+		close(stats_fd);
+		stats_fd = -1;
+	}
+	if (stats_buf != NULL) {
+		free(stats_buf);
+		stats_buf = NULL;
+	}
+}
+
+/*
+Scans diskstats for the lines of our drives:
+	   8       0 sda 1234 56 78910 1112 1314 ...
+reads completed is the 4th field, writes completed the 8th, the I/Os in flight the 12th.
+A drive that has done any I/O, or has some in flight, has been active just now.
+*/
+bool stats_read(struct timespec const *now) {
+	unsigned long long io, busy;
+	char *p, *end, *name;
+	size_t name_len;
+	ssize_t len;
+	int i, j;
+	
+	if ((len = pread(stats_fd, stats_buf, STATS_LENGTH - 1, 0)) <= 0) return false;
+	stats_buf[len] = '\0';
+	if ((len == STATS_LENGTH - 1) && (stats_truncated == false)) {
+		log_msg(LOG_WARNING, "diskstats is longer than %d bytes, drives listed after that are not seen.\n", STATS_LENGTH - 1);
+		stats_truncated = true;
+	}
+	
+	for (p = stats_buf; *p != '\0'; p = end) {
+		if ((end = strchr(p, '\n')) != NULL) *end++ = '\0';
+		else end = p + strlen(p);
+		
+		strtoul(p, &p, 10);
+		strtoul(p, &p, 10);
+		while (*p == ' ') p++;
+		for (name = p; (*p != ' ') && (*p != '\0'); p++);
+		name_len = (size_t) (p - name);
+		
+		for (i=0; i<pm0_conf.m_drive_count; i++) {
+			if ((strncmp(drives[i].m_dev, name, name_len) == 0) && (drives[i].m_dev[name_len] == '\0')) break;
+		}
+		if (i == pm0_conf.m_drive_count) continue;
+		
+		io = strtoull(p, &p, 10);
+		for (j=0; j<3; j++) strtoull(p, &p, 10);
+		io += strtoull(p, &p, 10);
+		for (j=0; j<3; j++) strtoull(p, &p, 10);
+		busy = strtoull(p, &p, 10);
+		
+		if ((stats_drives[i].m_seen == false) || (io != stats_drives[i].m_io) || (busy > 0)) {
+			stats_drives[i].m_seen = true;
+			stats_drives[i].m_idle = false;
+			stats_drives[i].m_io = io;
+			stats_drives[i].m_active_at = *now;
+		}
+	}
+	return true;
+}
+
+//STANDBY IMMEDIATE takes a while, so it is sent by a child, which is reaped through SIGCHLD
+void stats_spindown(int n) {
+	unsigned char args[4] = { ATA_STANDBY_NOW, 0, 0, 0 };
+	pid_t cp;
+	
+	if (stats_drives[n].m_dev_fd == -1) return;
+	
+	if ((cp = fork()) == -1) {
+		log_msg(LOG_ERR, "fork() failed: %s\n", strerror(errno));
+		return;
+	}
+	if (cp > 0) return;
+	
+	if (ioctl(stats_drives[n].m_dev_fd, HDIO_DRIVE_CMD, args) == -1) {
+		syslog(LOG_WARNING, "HDIO_DRIVE_CMD failed on HDD-%d, it stays spun up: %s\n", n, strerror(errno));
+		_exit(ERR_STATS);
+	}
+	_exit(ALL_OK);
+}
+
+/*
+A drive in a group is idle once none of its group has done I/O for the timeout of the
+group, so the members go to standby together. While a scheduled window is open, its
+timeout applies to the groups too.
+*/
+void on_stats(ev_source_t *src) {
+	struct timespec now, active_at;
+	union sigval value;
+	unsigned long timeout;
+	int i, j, g;
+	
+	if (ev_expired(src) == false) return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (stats_read(&now) == false) {
+		log_msg(LOG_ERR, "pread() failed on diskstats: %s\n", strerror(errno));
+		return;
+	}
+	
+	for (i=0; i<pm0_conf.m_drive_count; i++) {
+		if ((stats_drives[i].m_seen == false) || (stats_drives[i].m_idle == true)) continue;
+		active_at = stats_drives[i].m_active_at;
+		timeout = stats_timeout;
+		if ((g = group_of(i)) != -1) {
+			for (j=0; j<pm0_conf.m_drive_count; j++) {
+				if (((pm0_conf.m_groups[g].m_drives & (1u << j)) == 0) || (stats_drives[j].m_seen == false)) continue;
+				if (elapsed_ms(&active_at, &stats_drives[j].m_active_at) > 0) active_at = stats_drives[j].m_active_at;
+			}
+			if ((pm0_conf.m_groups[g].m_timeout > 0) && (windows_active == 0)) timeout = pm0_conf.m_groups[g].m_timeout;
+		}
+		if (elapsed_ms(&active_at, &now) < (long) (timeout * 60000)) continue;
+		
+		stats_drives[i].m_idle = true;
+		stats_spindown(i);
+		value.sival_int = i;
+		if (sigqueue(stats_pid, RT_STANDBY, value) == -1) {
+			log_msg(LOG_ERR, "sigqueue() failed: %s\n", strerror(errno));
+		}
+	}
+}
+
+//=========== EVENT LOOP ==========
+
+/*
+A single epoll loop serves every event source: the signals (through a signalfd), the
+coalescing window and the housekeeping tick (through timerfds). The sources are static,
+so dispatching an event never allocates.
+*/
+int ev_init(void) {
+	if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+		log_msg(LOG_ERR, "epoll_create1() failed: %s\n", strerror(errno));
+		return ERR_EVENT_LOOP;
+	}
+	return ALL_OK;
+}
+
+//takes over fd, which may be -1 if creating it has failed
+int ev_add(ev_source_t *src, int fd, void (*handler)(ev_source_t *)) {
+	struct epoll_event ev;
+	
+	if (fd == -1) {
+		log_msg(LOG_ERR, "Creating an event source failed: %s\n", strerror(errno));
+		return ERR_EVENT_LOOP;
+	}
+	
+	src->m_fd = fd;
+	src->m_handler = handler;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = src;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		log_msg(LOG_ERR, "epoll_ctl() failed: %s\n", strerror(errno));
+		return ERR_EVENT_LOOP;
+	}
+	return ALL_OK;
+}
+
+void ev_release(void) {
+	ev_source_t *sources[] = { &ev_signal, &ev_coalesce, &ev_tick, &ev_control, &ev_schedule, &ev_hooks, &ev_stats, &ev_attr, &ev_hotset, &ev_resume, NULL };
+	int i;
+	
+	for (i=0; sources[i] != NULL; i++) {
+		if (sources[i]->m_fd != -1) {
+			close(sources[i]->m_fd);
+			sources[i]->m_fd = -1;
+		}
+	}
+	if (epoll_fd != -1) {
+		close(epoll_fd);
+		epoll_fd = -1;
+	}
+}
+
+//(re)arms a timerfd source to fire after ms, and then every interval ms (0: once)
+int ev_arm(ev_source_t *src, unsigned long ms, unsigned long interval) {
+	struct itimerspec its;
+	
+	its.it_value.tv_sec = ms / 1000;
+	its.it_value.tv_nsec = (ms % 1000) * 1000000;
+	its.it_interval.tv_sec = interval / 1000;
+	its.it_interval.tv_nsec = (interval % 1000) * 1000000;
+	if (timerfd_settime(src->m_fd, 0, &its, NULL) == -1) {
+		log_msg(LOG_ERR, "timerfd_settime() failed: %s\n", strerror(errno));
+		return ERR_EVENT_LOOP;
+	}
+	return ALL_OK;
+}
+
+//consumes the expiration count of a timerfd source
+bool ev_expired(ev_source_t *src) {
+	uint64_t expirations;
+	
+	return (read(src->m_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) ? true : false;
+}
+
+void ev_loop(void) {
+	struct epoll_event events[EV_MAX_EVENTS];
+	ev_source_t *src;
+	int i, n;
+	
+	while (true) {
+		//spin-ups and resumes noticed while logging from within a handler
+		if ((spinup_drives | resumed_drives) != 0) drives_dispatch();
+		if ((n = epoll_wait(epoll_fd, events, EV_MAX_EVENTS, -1)) == -1) {
+			if (errno == EINTR) continue;
+			log_msg(LOG_ERR, "epoll_wait() failed: %s\n", strerror(errno));
+			cleanup_daemon();
+			exit(ERR_EVENT_LOOP);
+		}
+		for (i=0; i<n; i++) {
+			src = (ev_source_t *) events[i].data.ptr;
+			src->m_handler(src);
+		}
+	}
+}
+
+/*
+The SIGUSR1 and SIGUSR2 signals are set aside for you to use any way you want.
+They're useful for interprocess communication. Since these signals are normally fatal,
+you should write a signal handler for them in the program that receives the signal. 
+*/
+void on_signal(ev_source_t *src) {
+	struct signalfd_siginfo info;
+	int i;
+	
+	while (read(src->m_fd, &info, sizeof(info)) == sizeof(info)) {
+		if ((i = pm0_conf.m_backend->m_drive_of(&info)) != -1) {
+			drive_standby(i);
+			log_msg(LOG_NOTICE, "SATA HDD-%d standby initiated...\n", i);
+			//plugins alone are called as well
+			if ((pm0_conf.m_hook_count > 0) || (pm0_conf.m_plugin_count > 0)) queue_suspend(i);
+			continue;
+		}
+		switch (info.ssi_signo) {
+			case SIGCHLD:
+				reap_children();
+				break;
+			case SIGHUP:
+				reload_config();
+				break;
+			case SIGQUIT:
+			case SIGTERM:
+				if (pm0_conf.m_verbose == true) {
+					log_msg(LOG_INFO, "Caught SIGTERM/SIGQUIT, now exiting...\n");
+				}
+				cleanup_daemon();
+				exit(ALL_OK);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void on_coalesce(ev_source_t *src) {
+	if (ev_expired(src) == true) run_suspend(HOOK_STANDBY);
+}
+
+//a sleeping drive is looked at more often than on the tick, so the resume hooks run soon after a spin-up
+void on_resume(ev_source_t *src) {
+	if (ev_expired(src) == false) return;
+	drives_resumed();
+	if (drives_asleep() == false) ev_arm(src, 0, 0);
+}
+
+//held log lines don't have to wait for the next message once a drive is up again
+void on_tick(ev_source_t *src) {
+	if (ev_expired(src) == false) return;
+	if (drives_asleep() == true) drives_resumed();
+	drives_idle();
+	count_hook_procs();
+	if (metrics_dirty == true) write_metrics();
+}
+
+//=========== CONTROL SOCKET ==========
+
+/*
+pm0ctl talks to the daemon through a UNIX domain socket. Every answer comes from what
+the daemon already has in memory, so a query never sends a command to a sleeping drive.
+Commands are served one at a time, straight from the event loop.
+*/
+int open_control(void) {
+	char const *path = (pm0_conf.m_control_socket != NULL) ? pm0_conf.m_control_socket : CTL_SOCKET;
+	struct sockaddr_un addr;
+	mode_t old_mask;
+	int fd;
+	
+	if (strlen(path) == 0) return ALL_OK;//disabled
+	
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		log_msg(LOG_ERR, "The control socket path \'%s\' is too long!\n", path);
+		return ERR_CONTROL_SOCKET;
 	}
 	
-	return ALL_OK;
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+		log_msg(LOG_ERR, "socket() failed: %s\n", strerror(errno));
+		return ERR_CONTROL_SOCKET;
+	}
+	
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	
+	//a leftover of a daemon that did not exit cleanly, the PID file check has already been done
+	unlink(path);
+	
+	old_mask = umask(S_IRWXG | S_IRWXO);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		log_msg(LOG_ERR, "bind() failed on \'%s\': %s\n", path, strerror(errno));
+		umask(old_mask);
+		close(fd);
+		return ERR_CONTROL_SOCKET;
+	}
+	umask(old_mask);
+	
+	if (listen(fd, 4) == -1) {
+		log_msg(LOG_ERR, "listen() failed on \'%s\': %s\n", path, strerror(errno));
+		close(fd);
+		unlink(path);
+		return ERR_CONTROL_SOCKET;
+	}
+	
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Listening for control commands on \'%s\'.\n", path);
+	}
+	
+	return ev_add(&ev_control, fd, on_control);
 }
 
-void close_config(config_t *conf_main) {
-	config_destroy(conf_main);
+void close_control(void) {
+	char const *path = (pm0_conf.m_control_socket != NULL) ? pm0_conf.m_control_socket : CTL_SOCKET;
+	
+	if (ev_control.m_fd != -1) {
+		close(ev_control.m_fd);
+		ev_control.m_fd = -1;
+		unlink(path);
+	}
 }
 
-#endif //WITH_LIBCONFIG
- 
-void cleanup_daemon() {
-	int i=0;
+void on_control(ev_source_t *src) {
+	char line[CTL_LINE_LENGTH], reply[CTL_REPLY_LENGTH];
+	struct timeval tv = { CTL_TIMEOUT, 0 };
+	char const *out;
+	char *arg;
+	ssize_t len;
+	int fd;
 	
-	if (pm0_conf.m_verbose == true) {
-		syslog(LOG_INFO, "Cleaning up after daemon_task().\n");
+	while ((fd = accept4(src->m_fd, NULL, NULL, SOCK_CLOEXEC)) != -1) {
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		
+		if ((len = read(fd, line, CTL_LINE_LENGTH-1)) <= 0) {
+			close(fd);
+			continue;
+		}
+		line[len] = '\0';
+		line[strcspn(line, "\r\n")] = '\0';
+		
+		if ((arg = strchr(line, ' ')) != NULL) *(arg++) = '\0';
+		else arg = "";
+		
+		out = reply;
+		if (strcmp(line, "status") == 0) ctl_status(reply, CTL_REPLY_LENGTH);
+		else if (strcmp(line, "timeout") == 0) ctl_timeout(reply, CTL_REPLY_LENGTH, arg);
+		else if (strcmp(line, "trigger") == 0) ctl_trigger(reply, CTL_REPLY_LENGTH, arg);
+		else if (strcmp(line, "policy") == 0) ctl_policy(reply, CTL_REPLY_LENGTH);
+		else if (strcmp(line, "metrics") == 0) out = ctl_metrics();
+		else if (strcmp(line, "wakeups") == 0) ctl_wakeups(reply, CTL_REPLY_LENGTH);
+		else snprintf(reply, CTL_REPLY_LENGTH, "%s unknown command \'%s\'\n", CTL_ERR, line);
+		
+		if (write(fd, out, strlen(out)) == -1) {
+			log_msg(LOG_WARNING, "write() failed on the control socket: %s\n", strerror(errno));
+		}
+		close(fd);
+	}
+}
+
+//the suspend timeout and, for every drive, its last known state and recent standby events
+void ctl_status(char *reply, size_t size) {
+	struct timespec now;
+	struct tm tm_buf;
+	size_t len;
+	int i, j;
+	
+	drives_resumed();
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	len = snprintf(reply, size, "%s\ntimeout %lu\n", CTL_OK, pm0_conf.m_timeout);
+	
+	for (i=0; (i<pm0_conf.m_drive_count) && (len < size); i++) {
+		len += snprintf(reply + len, size - len, "HDD-%d dev=%s state=%s events=%lu",
+			i, drives[i].m_dev,
+			((drives[i].m_stat_fd == -1) && (drives[i].m_standby == false)) ? "unknown" : drive_power_names[drives[i].m_power],
+			drives[i].m_events);
+		
+		//newest first
+		for (j=1; (j<=EVENT_HISTORY) && ((unsigned long) j <= drives[i].m_events) && (len < size); j++) {
+			len += strftime(reply + len, size - len, (j == 1) ? " recent=%Y-%m-%dT%H:%M:%S" : ",%Y-%m-%dT%H:%M:%S",
+				localtime_r(&drives[i].m_event_times[(drives[i].m_events - j) % EVENT_HISTORY], &tm_buf));
+		}
+		
+		if ((len < size) && ((drives[i].m_last_hook.tv_sec != 0) || (drives[i].m_last_hook.tv_nsec != 0))) {
+			len += snprintf(reply + len, size - len, " last_hook=%lds", elapsed_ms(&drives[i].m_last_hook, &now) / 1000);
+		}
+		if ((len < size) && (drives[i].m_spinups > 0)) {
+			len += snprintf(reply + len, size - len, " last_standby=%lus spinup=%lums",
+				drives[i].m_last_standby_ms / 1000, drives[i].m_last_spinup_ms);
+		}
+		if (len < size) len += snprintf(reply + len, size - len, "\n");
 	}
+}
+
+void ctl_timeout(char *reply, size_t size, char const *arg) {
+	unsigned long timeout;
+	char *end;
 	
-	if (remove(PID_FILE) != 0) {
-		syslog(LOG_ERR, "remove() failed on \'%s\': %s\n", PID_FILE, strerror(errno));
+	timeout = strtoul(arg, &end, 10);
+	if ((end == arg) || (*end != '\0') || (timeout == 0)) {
+		snprintf(reply, size, "%s usage: timeout <minutes>\n", CTL_ERR);
+		return;
 	}
-	if (pm0_conf.m_suspend_exec != NULL) free(pm0_conf.m_suspend_exec);
-	if (pm0_conf.m_suspend_args != NULL) {
-		while (pm0_conf.m_suspend_args[i] != NULL) free(pm0_conf.m_suspend_args[i++]);
-		free(pm0_conf.m_suspend_args);
+	
+	if (pm0_conf.m_backend->m_set_idletime(timeout) != ALL_OK) {
+		snprintf(reply, size, "%s setting the timeout has failed\n", CTL_ERR);
+		return;
 	}
-	closelog();
+	
+	log_msg(LOG_NOTICE, "Suspend timeout changed from %lu to %lu minute(s).\n", pm0_conf.m_timeout, timeout);
+	pm0_conf.m_timeout = timeout;
+	snprintf(reply, size, "%s\ntimeout %lu\n", CTL_OK, timeout);
 }
 
+//runs the hook for a drive right away, regardless of coalescing and cooldown
+void ctl_trigger(char *reply, size_t size, char const *arg) {
+	char *end;
+	long n;
+	
+	n = strtol(arg, &end, 10);
+	if ((end == arg) || (*end != '\0') || (n < 0) || (n >= pm0_conf.m_drive_count)) {
+		snprintf(reply, size, "%s usage: trigger <drive>\n", CTL_ERR);
+		return;
+	}
+	if ((pm0_conf.m_hook_count == 0) && (pm0_conf.m_plugin_count == 0)) {
+		snprintf(reply, size, "%s no hooks or plugins are set\n", CTL_ERR);
+		return;
+	}
+	
+	log_msg(LOG_NOTICE, "Running the hook of HDD-%ld on request.\n", n);
+	journal_write(JOURNAL_TRIGGER, 1u << n, 0, 0, 0);
+	pending_drives |= (1u << n);
+	run_suspend(HOOK_TRIGGER);
+	snprintf(reply, size, "%s\n", CTL_OK);
+}
 
-void cleanup_main() {
-	int i=0;
+//the bounds of the adaptive timeout and its recent decisions, newest first
+void ctl_policy(char *reply, size_t size) {
+	decision_t const *d;
+	struct tm tm_buf;
+	size_t len;
+	unsigned long i;
 	
-	if (pm0_conf.m_verbose == true) {
-		fprintf(stderr, "Cleaning up after main().\n");
+	len = snprintf(reply, size, "%s\nadaptive %s timeout %lu min %lu max %lu breakeven %lu\n", CTL_OK,
+		(pm0_conf.m_adaptive == true) ? "on" : "off", pm0_conf.m_timeout,
+		pm0_conf.m_min_timeout, pm0_conf.m_max_timeout, pm0_conf.m_breakeven);
+	
+	for (i=1; (i<=ADAPT_HISTORY) && (i<=decision_count) && (len < size); i++) {
+		d = &decisions[(decision_count - i) % ADAPT_HISTORY];
+		len += strftime(reply + len, size - len, "%Y-%m-%dT%H:%M:%S", localtime_r(&d->m_when, &tm_buf));
+		if (len < size) {
+			len += snprintf(reply + len, size - len, " HDD-%d standby=%lus timeout %lu -> %lu\n",
+				d->m_drive, d->m_gap, d->m_old_timeout, d->m_new_timeout);
+		}
 	}
+}
+
+//the metrics may not fit in a reply, so they go out from their own buffer
+char const *ctl_metrics(void) {
+	size_t len = snprintf(metrics_buf, metrics_size, "%s\n", CTL_OK);
+	
+	render_metrics(metrics_buf + len, metrics_size - len);
+	return metrics_buf;
+}
+
+//the last spin-up of every drive, with the processes that touched it during its standby
+void ctl_wakeups(char *reply, size_t size) {
+	wake_report_t const *r;
+	culprit_t const *c;
+	struct tm tm_buf;
+	size_t len;
+	int i, j;
+	
+	drives_resumed();
+	len = snprintf(reply, size, "%s\nattribution %s\n", CTL_OK, (ev_attr.m_fd != -1) ? "on" : "off");
 	
-	if (pm0_conf.m_suspend_exec != NULL) free(pm0_conf.m_suspend_exec);
-	if (pm0_conf.m_suspend_args != NULL) {
-		while (pm0_conf.m_suspend_args[i] != NULL) free(pm0_conf.m_suspend_args[i++]);
-		free(pm0_conf.m_suspend_args);
+	for (i=0; (i<pm0_conf.m_drive_count) && (len < size); i++) {
+		r = &attr_reports[i];
+		if (r->m_when == 0) continue;
+		len += strftime(reply + len, size - len, "%Y-%m-%dT%H:%M:%S", localtime_r(&r->m_when, &tm_buf));
+		if (len < size) {
+			len += snprintf(reply + len, size - len, " HDD-%d standby=%lus culprits=%d\n", i, r->m_standby, r->m_count);
+		}
+		for (j=0; (j<r->m_count) && (len < size); j++) {
+			c = &r->m_culprits[j];
+			len += snprintf(reply + len, size - len, "  %d %s[%d] after=%lus accesses=%lu first=%s\n",
+				j+1, c->m_comm, (int) c->m_pid, c->m_after, c->m_accesses, c->m_path);
+		}
 	}
 }
 
+//=========== RELOAD ==========
 
-void close_file(int fd, char *str) {
-		if (close(fd) == -1) {
-				syslog(LOG_ERR, "close() failed on \'%s\': %s\n", str, strerror(errno));
-				cleanup_daemon();
+/*
+A SIGHUP builds a new configuration off to the side, from the same command line and
+the config file as it is now. Its hooks are staged and checked like at startup, and
+only if all of that works out is it swapped in; otherwise the old one stays. The
+backend keeps our PID registered throughout, so no standby event goes astray, and it
+is only given a new timeout if the configured one has changed.
+*/
+void reload_config(void) {
+	conf_t next = CONF_DEFAULTS;
+	conf_t prev;
+	unsigned long applied = pm0_conf.m_timeout, wanted;
+	int first = staged_count, i, j;
+	
+	log_msg(LOG_NOTICE, "Reloading the configuration from \'%s\'.\n", pm0_conf.m_conf_file);
+	
+	if ((i = load_conf(&next, saved_argc, saved_argv)) == ALL_OK) {
+		if ((pm0_conf.m_resident == true) && (next.m_hook_count > 0)) i = stage_hooks(&next);
+		for (j=0; (i == ALL_OK) && (j<next.m_hook_count); j++) i = prepare_exec(&next, &next.m_hooks[j]);
+		if ((i == ALL_OK) && (pm0_conf.m_strict == true)) i = check_strict(&next, first);
+	}
+	if (i != ALL_OK) {
+		log_msg(LOG_ERR, "Reloading the configuration has failed (%d), keeping the old one.\n", i);
+		drop_staged(first, staged_count);
+		free_conf(&next);
+		return;
+	}
+	
+	if (next.m_strict == true) next.m_resident = true;
+	keep_restart_only(&next);
+	if ((i = check_drive_refs(&next)) != ALL_OK) {
+		log_msg(LOG_ERR, "Reloading the configuration has failed (%d), keeping the old one.\n", i);
+		drop_staged(first, staged_count);
+		free_conf(&next);
+		return;
+	}
+	
+	//a hook still running counts against max_running of the same command in the new configuration
+	for (j=0; j<HOOK_SLOTS; j++) {
+		if (hook_runs[j].m_hook == NULL) continue;
+		if ((hook_runs[j].m_pid != 0) && ((hook_runs[j].m_hook = same_hook(&next, hook_runs[j].m_hook)) != NULL)) {
+			hook_runs[j].m_hook->m_running++;
 		}
+		else hook_runs[j].m_hook = NULL;
+	}
+	
+	//the timeout set by pm0ctl, the adaptive policy or a window stays, unless the configured one has changed
+	if (next.m_timeout != conf_timeout) wanted = next.m_timeout;
+	else wanted = (windows_active > 0) ? base_timeout : applied;
+	conf_timeout = next.m_timeout;
+	
+	prev = pm0_conf;
+	pm0_conf = next;
+	pm0_conf.m_timeout = wanted;
+	for (j=0; j<pm0_conf.m_drive_count; j++) {
+		drives[j].m_dev = (pm0_conf.m_drive_dev[j] != NULL) ? pm0_conf.m_drive_dev[j] : default_drive_dev[j];
+	}
+	drop_staged(0, first);
+	free_conf(&prev);
+	
+	//the windows of the new schedule are opened afresh, and may raise the timeout themselves
+	windows_active = 0;
+	base_timeout = 0;
+	if (open_schedule() != ALL_OK) {
+		log_msg(LOG_WARNING, "The new schedule could not be set up, no drive will be woken for it.\n");
+	}
+	if (open_hotset() != ALL_OK) {
+		log_msg(LOG_WARNING, "The new hot set could not be set up, it won't be refreshed.\n");
+	}
+	open_groups();
+	
+	if ((pm0_conf.m_timeout == wanted) && (wanted != applied)) {
+		if (pm0_conf.m_backend->m_set_idletime(wanted) == ALL_OK) {
+			log_msg(LOG_NOTICE, "Suspend timeout changed from %lu to %lu minute(s).\n", applied, wanted);
+		}
+		else pm0_conf.m_timeout = applied;
+	}
+	metrics_dirty = true;
+	
+	log_msg(LOG_NOTICE, "Configuration reloaded: %d hook(s), %d scheduled window(s).\n", pm0_conf.m_hook_count, pm0_conf.m_window_count);
 }
 
-void fclose_file(FILE *file, char *str) {
-		if (fclose(file) == -1) {
-				fprintf(stderr, "fclose() failed on \'%s\': %s", str, strerror(errno));
+//settings tied to what has been set up at startup only change with a restart
+void keep_restart_only(conf_ptr_t next) {
+	int i;
+	
+	if (next->m_backend != pm0_conf.m_backend) {
+		log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", "main.backend");
+		next->m_backend = pm0_conf.m_backend;
+	}
+	if (next->m_resident != pm0_conf.m_resident) {
+		log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", "main.resident");
+		next->m_resident = pm0_conf.m_resident;
+	}
+	if (next->m_strict != pm0_conf.m_strict) {
+		log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", "main.strict");
+		next->m_strict = pm0_conf.m_strict;
+	}
+	if (next->m_drive_count != pm0_conf.m_drive_count) {
+		log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", "main.drives");
+		next->m_drive_count = pm0_conf.m_drive_count;
+	}
+	if (next->m_attribution != pm0_conf.m_attribution) {
+		log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", "main.attribution");
+		next->m_attribution = pm0_conf.m_attribution;
+	}
+	if (next->m_laptop_mode != pm0_conf.m_laptop_mode) {
+		log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", "laptop_mode.enabled");
+		next->m_laptop_mode = pm0_conf.m_laptop_mode;
+	}
+	if (next->m_log_buffer != pm0_conf.m_log_buffer) {
+		log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", "main.log_buffer");
+		next->m_log_buffer = pm0_conf.m_log_buffer;
+	}
+	for (i=0; i<MAX_DRIVES; i++) {
+		if (next->m_sim_interval[i] != pm0_conf.m_sim_interval[i]) {
+			log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", "simulator.interval");
+			next->m_sim_interval[i] = pm0_conf.m_sim_interval[i];
+		}
+		keep_string(next, &next->m_drive_dev[i], &pm0_conf.m_drive_dev[i], "main.drives");
+	}
+	keep_string(next, &next->m_staging_dir, &pm0_conf.m_staging_dir, "main.staging_dir");
+	keep_string(next, &next->m_proc_root, &pm0_conf.m_proc_root, "main.proc_root");
+	keep_string(next, &next->m_sys_root, &pm0_conf.m_sys_root, "main.sys_root");
+	keep_string(next, &next->m_control_socket, &pm0_conf.m_control_socket, "main.control_socket");
+	keep_string(next, &next->m_metrics_file, &pm0_conf.m_metrics_file, "main.metrics_file");
+	keep_string(next, &next->m_journal_file, &pm0_conf.m_journal_file, "main.journal_file");
+	if (next->m_journal_records != pm0_conf.m_journal_records) {
+		log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", "main.journal_records");
+		next->m_journal_records = pm0_conf.m_journal_records;
+	}
+	keep_string(next, &next->m_stats_root, &pm0_conf.m_stats_root, "diskstats.root");
+	if ((next->m_stats_interval != pm0_conf.m_stats_interval) || (next->m_spindown != pm0_conf.m_spindown)) {
+		log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", "diskstats.*");
+		next->m_stats_interval = pm0_conf.m_stats_interval;
+		next->m_spindown = pm0_conf.m_spindown;
+	}
+	keep_plugins(next);
+}
+
+/*
+The windows, hooks and groups of the new configuration were checked against the drives
+it lists itself, but those only change with a restart: keep_restart_only() has put back
+the running count, so they are checked again against that one.
+*/
+int check_drive_refs(conf_cptr_t next) {
+	unsigned int all = (1u << next->m_drive_count) - 1;
+	int i;
+	
+	for (i=0; i<next->m_window_count; i++) {
+		if (next->m_windows[i].m_drive >= next->m_drive_count) {
+			log_msg(LOG_ERR, "A scheduled window is for HDD-%d, but only %d drive(s) are in use until a restart!\n",
+				next->m_windows[i].m_drive, next->m_drive_count);
+			return ERR_SCHEDULE;
+		}
+	}
+	//~0u is the default, all of the drives
+	for (i=0; i<next->m_hook_count; i++) {
+		if ((next->m_hooks[i].m_drives != ~0u) && ((next->m_hooks[i].m_drives & ~all) != 0)) {
+			log_msg(LOG_ERR, "The hook \'%s\' is for a drive beyond the %d in use until a restart!\n",
+				next->m_hooks[i].m_exec, next->m_drive_count);
+			return ERR_HOOKS;
+		}
+	}
+	for (i=0; i<next->m_group_count; i++) {
+		if ((next->m_groups[i].m_drives & ~all) != 0) {
+			log_msg(LOG_ERR, "Group %d has a drive beyond the %d in use until a restart!\n", i, next->m_drive_count);
+			return ERR_GROUPS;
 		}
+	}
+	return ALL_OK;
+}
+
+/*
+The hook of the new configuration that runs the same command as old (of the running one),
+preferably the one in the same place, or NULL. The command is compared as configured, in
+m_args[0], since m_exec is renamed by staging.
+*/
+hook_t *same_hook(conf_ptr_t next, hook_t const *old) {
+	int n = old - pm0_conf.m_hooks, i;
+	
+	if ((n < next->m_hook_count) && (strcmp(next->m_hooks[n].m_args[0], old->m_args[0]) == 0)) return &next->m_hooks[n];
+	for (i=0; i<next->m_hook_count; i++) {
+		if (strcmp(next->m_hooks[i].m_args[0], old->m_args[0]) == 0) return &next->m_hooks[i];
+	}
+	return NULL;
+}
+
+//copies the old value of a string setting over to the arena of the new configuration
+void keep_string(conf_ptr_t p_next, char **next, char **old, char const *name) {
+	if (((*next == NULL) != (*old == NULL)) || ((*next != NULL) && (strcmp(*next, *old) != 0))) {
+		log_msg(LOG_WARNING, "Changing %s needs a restart, keeping the old value.\n", name);
+	}
+	if ((*next = (*old != NULL) ? arena_strdup(p_next, *old) : NULL) == NULL) {
+		if (*old != NULL) log_msg(LOG_ERR, "arena_strdup() failed, %s falls back to its default!\n", name);
+	}
 }
 
 //=========== DAEMON ==========
 
 void daemon_task() {
 	sigset_t listen_set;
-	struct stat buf;
 	unsigned long d_pid = getpid();//daemon-pid - kernel expects it to be "unsigned long"
-	int dev_file, pid_file, sig;
+	int pid_file, i, j;
 	char pid_buf[PID_TXT_LENGTH] = {0};
 	
 	openlog(EXEC_NAME, LOG_NDELAY | LOG_PID, LOG_DAEMON);
 	
+	log_stderr();
+	
+	//without TZ, every mktime() stat()s /etc/localtime to see if it has changed
+	if (getenv("TZ") == NULL) setenv("TZ", ":" LOCALTIME, 1);
+	tzset();
+	
 	if (pm0_conf.m_verbose == true) {
-		syslog(LOG_INFO, "The %s daemon has started with PID %lu.\n", EXEC_NAME, d_pid);
+		log_msg(LOG_INFO, "The %s daemon has started with PID %lu.\n", EXEC_NAME, d_pid);
+	}
+	
+	open_drives();
+	
+	if (((i = init_log()) != ALL_OK) || ((i = open_metrics()) != ALL_OK) || ((i = open_journal()) != ALL_OK)) {
+		cleanup_daemon();
+		exit(i);
 	}
 	
 	//create, fill and close PID file
 	
 	if ((pid_file = open(PID_FILE, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
-		syslog(LOG_ERR, "open() failed on \'%s\': %s\n", PID_FILE, strerror(errno));
+		log_msg(LOG_ERR, "open() failed on \'%s\': %s\n", PID_FILE, strerror(errno));
 		cleanup_daemon();
 		exit(ERR_OPEN_FAIL);
 	}
@@ -469,7 +5461,7 @@ void daemon_task() {
 	snprintf(pid_buf, PID_TXT_LENGTH, "%lu", d_pid);
 	
 	if (write(pid_file, (void *) pid_buf, strlen(pid_buf)) < 0) {
-		syslog(LOG_ERR, "write() failed on \'%s\': %s\n", PID_FILE, strerror(errno));
+		log_msg(LOG_ERR, "write() failed on \'%s\': %s\n", PID_FILE, strerror(errno));
 		close_file(pid_file, PID_FILE);
 		cleanup_daemon();
 		exit(ERR_WRITE_FAIL);
@@ -477,132 +5469,108 @@ void daemon_task() {
 	
 	close_file(pid_file, PID_FILE);
 	
-	//inspect and open device file for later use
-
-	if (pm0_conf.m_verbose == true) {
-		syslog(LOG_INFO, "Checking and opening device file \'%s\'.\n", DEV_FILE);
-	}
+	//move the hooks off the disk and pin ourselves in memory
 	
-	if (stat(DEV_FILE, &buf) == -1) {
-			syslog(LOG_ERR, "stat() failed on \'%s\': %s\n", DEV_FILE, strerror(errno));
-			cleanup_daemon();
-			exit(ERR_STAT_OTHER);
-	}
-	else {
-		if ((buf.st_mode & S_IFMT) != S_IFCHR) {
-			syslog(LOG_ERR, "\'%s\' is not a character device!\n", DEV_FILE);
-			cleanup_daemon();
-			exit(ERR_DEV_FILE);
+	if ((pm0_conf.m_strict == true) && (pm0_conf.m_resident == false)) {
+		if (pm0_conf.m_verbose == true) {
+			log_msg(LOG_INFO, "Strict mode implies resident mode.\n");
 		}
+		pm0_conf.m_resident = true;
 	}
 	
-
-	if ((dev_file = open(DEV_FILE, O_NONBLOCK)) == -1) {
-		syslog(LOG_ERR, "open() failed on \'%s\': %s\n", DEV_FILE, strerror(errno));
+	if ((pm0_conf.m_resident == true) && ((i = go_resident()) != ALL_OK)) {
 		cleanup_daemon();
-		exit(ERR_OPEN_FAIL);
+		exit(i);
 	}
 	
-	//kick off our ioctls
-	
-	if (pm0_conf.m_verbose == true) {
-		syslog(LOG_INFO, "Registering %s power management daemon in kernel.\n", EXEC_NAME);
-	}
+	//check the hooks once, instead of on every standby event
 	
-	if (ioctl(dev_file, IOCTL_PM0_REGISTER_PID, &d_pid) == -1) {
-		syslog(LOG_ERR, "IOCTL_PM0_REGISTER_PID failed: %s\n", strerror(errno));
-		close_file(dev_file, DEV_FILE);
-		cleanup_daemon();
-		exit(ERR_IOCTL_PID);
+	for (j=0; j<pm0_conf.m_hook_count; j++) {
+		if ((i = prepare_exec(&pm0_conf, &pm0_conf.m_hooks[j])) != ALL_OK) {
+			cleanup_daemon();
+			exit(i);
+		}
 	}
 	
-	if (pm0_conf.m_verbose == true) {
-		syslog(LOG_INFO, "Setting suspend timeout for hard disks to %lu minute(s).\n", pm0_conf.m_timeout);
-	}
+	//the plugins start while the drives are surely up, their init may open files
 	
-	if (ioctl(dev_file, IOCTL_PM0_SET_IDLETIME, pm0_conf.m_timeout) == -1) {
-		syslog(LOG_ERR, "IOCTL_PM0_SET_IDLETIME failed: %s\n", strerror(errno));
-		close_file(dev_file, DEV_FILE);
+	if ((i = open_plugins()) != ALL_OK) {
 		cleanup_daemon();
-		exit(ERR_IOCTL_TIMEOUT);
+		exit(i);
 	}
 	
-	//close our device file
-	
-	close_file(dev_file, DEV_FILE);
-	
-	
-	//register listeners for signals from the kernel
+	//register listeners for signals from the kernel before telling it our PID
 	sigemptyset(&listen_set);
-	sigaddset(&listen_set, SIGUSR1);
-	sigaddset(&listen_set, SIGUSR2);
+	pm0_conf.m_backend->m_event_signals(&listen_set);
 	sigaddset(&listen_set, SIGCHLD);
+	sigaddset(&listen_set, SIGHUP);
 	sigaddset(&listen_set, SIGTERM);
 	sigaddset(&listen_set, SIGQUIT);
 	if (sigprocmask(SIG_BLOCK, &listen_set, NULL) != 0) {
-		syslog(LOG_ERR, "sigwait() failed: %s\n", strerror(errno));
+		log_msg(LOG_ERR, "sigprocmask() failed: %s\n", strerror(errno));
 		cleanup_daemon();
 		exit(ERR_SIGPROCMASK_FAIL);
 	}
 	
-	/*
-	The SIGUSR1 and SIGUSR2 signals are set aside for you to use any way you want.
-	They're useful for interprocess communication. Since these signals are normally fatal,
-	you should write a signal handler for them in the program that receives the signal. 
-	*/
+	//open the device and kick off our ioctls, a backend may need the event loop for that
 	
-	if (pm0_conf.m_verbose == true) {
-		syslog(LOG_INFO, "Starting signal processing loop.\n");
+	if (((i = ev_init()) != ALL_OK) || ((i = pm0_conf.m_backend->m_open()) != ALL_OK)) {
+		cleanup_daemon();
+		exit(i);
 	}
 	
-	while (true) {
-			if (sigwait(&listen_set, &sig) == 0) {
-					switch (sig) {
-						case SIGUSR1:
-							syslog(LOG_NOTICE, "SATA HDD-1 standby initiated...\n");
-							if (pm0_conf.m_suspend_exec != NULL) exec_suspend(1);
-							break;
-						case SIGUSR2:
-							syslog(LOG_NOTICE, "SATA HDD-0 standby initiated...\n");
-							if (pm0_conf.m_suspend_exec != NULL) exec_suspend(0);
-							break;
-						case SIGCHLD:
-							while (waitpid(-1, NULL, WNOHANG) > 0);
-							break;
-						case SIGQUIT:
-						case SIGTERM:
-							if (pm0_conf.m_verbose == true) {
-								syslog(LOG_INFO, "Caught SIGTERM/SIGQUIT, now exiting...\n");
-							}
-							cleanup_daemon();
-							exit(ALL_OK);
-							break;
-						default:
-							break;
-					}
-			}
-			else {
-					syslog(LOG_ERR, "sigwait() failed: %s\n", strerror(errno));
-					cleanup_daemon();
-					exit(ERR_SIGWAIT_FAIL);
-			}
+	conf_timeout = pm0_conf.m_timeout;
+	if (((i = pm0_conf.m_backend->m_register_pid(d_pid)) != ALL_OK) ||
+		((i = pm0_conf.m_backend->m_set_idletime(pm0_conf.m_timeout)) != ALL_OK)) {
+		cleanup_daemon();
+		exit(i);
 	}
-
-
+	
+	//everything from here on is driven by the event loop
+	
+	if (((i = ev_add(&ev_signal, signalfd(-1, &listen_set, SFD_NONBLOCK | SFD_CLOEXEC), on_signal)) != ALL_OK) ||
+		((i = ev_add(&ev_coalesce, timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), on_coalesce)) != ALL_OK) ||
+		((i = ev_add(&ev_tick, timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), on_tick)) != ALL_OK) ||
+		((i = ev_add(&ev_hooks, timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), on_hook_timer)) != ALL_OK) ||
+		((i = ev_add(&ev_resume, timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), on_resume)) != ALL_OK) ||
+		((i = ev_arm(&ev_tick, POLL_INTERVAL, POLL_INTERVAL)) != ALL_OK) ||
+		((i = open_control()) != ALL_OK) ||
+		((i = open_schedule()) != ALL_OK) ||
+		((i = open_groups()) != ALL_OK) ||
+		((i = open_mounts()) != ALL_OK) ||
+		((i = open_attribution()) != ALL_OK) ||
+		((i = open_laptop_mode()) != ALL_OK) ||
+		((i = open_hotset()) != ALL_OK) ||
+		((pm0_conf.m_strict == true) && ((i = check_strict(&pm0_conf, 0)) != ALL_OK))) {
+		cleanup_daemon();
+		exit(i);
+	}
+	
+	if (pm0_conf.m_verbose == true) {
+		log_msg(LOG_INFO, "Starting event processing loop.\n");
+	}
+	
+	ev_loop();
 } 
  
  
 //=========== MAIN ==========
 
-int main(int argc, char **argv, char **env) {
-	char const *const optstr = "hvt:";
-	pid_t c_pid;//child-pid
-	struct stat buf;
-	int c, i, j;
+/*
+Builds a configuration from the command line and the config file, the latter only
+filling in what the former has left unset. main() loads pm0_conf with it, and a
+reload loads a fresh conf_t the same way, off to the side.
+*/
+int load_conf(conf_ptr_t target, int argc, char **argv) {
+	char const *const optstr = "hvrsc:t:b:";
+	char const *exec_arg = NULL;
+	size_t size = ARENA_BASE;
+	FILE *config_file;
+	struct stat stat_buf;
+	int c, i;
 
 #ifdef WITH_LIBCONFIG
 	config_t config_parser;
-	FILE *config_file;
 #endif //WITH_LIBCONFIG
 	
 #ifdef _GNU_SOURCE
@@ -612,10 +5580,16 @@ int main(int argc, char **argv, char **env) {
 			{"timeout", 1, NULL, 't'},
 			{"config", 1, NULL, 'c'},
 			{"exec", 1, NULL, 'x'},
+			{"backend", 1, NULL, 'b'},
+			{"resident", 0, NULL, 'r'},
+			{"strict", 0, NULL, 's'},
 			{NULL, 0, NULL, 0},
 		};
 #endif
-		
+	
+	//getopt() starts over from the first argument
+	optind = 0;
+	
 	while (true) {
 #ifdef _GNU_SOURCE
 		c = getopt_long(argc, argv, optstr, long_opts, NULL);
@@ -630,22 +5604,28 @@ int main(int argc, char **argv, char **env) {
 				exit(ALL_OK);
 				break;
 			case 'v':
-				pm0_conf.m_verbose = true;
+				target->m_verbose = true;
+				break;
+			case 'r':
+				target->m_resident = true;
+				break;
+			case 's':
+				target->m_strict = true;
 				break;
 			case 'c':
-				pm0_conf.m_conf_file = optarg;
+				target->m_conf_file = optarg;
 				break;
 			case 't':
-				pm0_conf.m_timeout = strtoul(optarg, NULL, 10);
+				target->m_timeout = strtoul(optarg, NULL, 10);
 				break;
-			case 'x':
-				i = strlen(optarg);
-				if ((pm0_conf.m_suspend_exec = (char *) calloc(i+1, sizeof(char))) == NULL) {
-					fprintf(stderr, "calloc() failed!\n");
-					cleanup_main();
-					exit(ERR_OUT_OF_MEMORY);
+			case 'b':
+				if ((target->m_backend = find_backend(optarg)) == NULL) {
+					fprintf(stderr, "Unknown backend \'%s\'!\n", optarg);
+					return ERR_UNKNOWN_BACKEND;
 				}
-				strncpy(pm0_conf.m_suspend_exec, optarg, i);
+				break;
+			case 'x':
+				exec_arg = optarg;
 				break;
 			case '?':
 			default:
@@ -655,72 +5635,112 @@ int main(int argc, char **argv, char **env) {
 		if (c == 'x') break;
 	}
 
+	//the whole configuration fits in an arena sized for the command line and the config file
+	for (i=0; i<argc; i++) size += strlen(argv[i]) + 1 + sizeof(char *);
+	if (stat(target->m_conf_file, &stat_buf) == 0) size += ARENA_PER_BYTE * (size_t) stat_buf.st_size;
+	if ((i = arena_init(target, size)) != ALL_OK) return i;
+	
+	if ((exec_arg != NULL) && ((target->m_suspend_exec = arena_strdup(target, exec_arg)) == NULL)) {
+		fprintf(stderr, "arena_strdup() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+	
 	//were there any arguments entered that belong to suspend_exec?
 	if ((c=='x') && ((optind+=2) < argc)) {
-		if ((pm0_conf.m_suspend_args = (char **) calloc((argc-optind)+2, sizeof(char *))) == NULL) {
-			fprintf(stderr, "calloc() failed!\n");
-			cleanup_main();
-			exit(ERR_OUT_OF_MEMORY);
+		if ((target->m_suspend_args = (char **) arena_alloc(target, ((argc-optind)+2) * sizeof(char *))) == NULL) {
+			fprintf(stderr, "arena_alloc() failed!\n");
+			return ERR_OUT_OF_MEMORY;
 		}
 		
+		target->m_suspend_args[0] = target->m_suspend_exec;
 		for (i=1; optind < argc; i++,optind++) {
-			j = strlen(argv[optind]);
-			if ((pm0_conf.m_suspend_args[i] = (char *) calloc(j+1, sizeof(char))) == NULL) {
-				fprintf(stderr, "calloc() failed!\n");
-				cleanup_main();
-				exit(ERR_OUT_OF_MEMORY);
+			if ((target->m_suspend_args[i] = arena_strdup(target, argv[optind])) == NULL) {
+				fprintf(stderr, "arena_strdup() failed!\n");
+				return ERR_OUT_OF_MEMORY;
 			}
-			strncpy(pm0_conf.m_suspend_args[i], argv[optind], j);
 		}
 	}
 	
 	//was suspend_exec defined on the command line?
-	if (pm0_conf.m_suspend_exec != NULL) {
+	if (target->m_suspend_exec != NULL) {
 		//if yes, were any arguments defined for it?
-		if (pm0_conf.m_suspend_args == NULL) {
-			if (pm0_conf.m_verbose == true) {
-					fprintf(stderr, "No argument list was supplied for \'%s\', setting up default empty one.\n", pm0_conf.m_suspend_exec);
+		if (target->m_suspend_args == NULL) {
+			if (target->m_verbose == true) {
+					fprintf(stderr, "No argument list was supplied for \'%s\', setting up default empty one.\n", target->m_suspend_exec);
 			}
-			if ((i = setup_default_args(&pm0_conf)) != ALL_OK) {
-				cleanup_main();
-				exit(i);
+			if ((i = setup_default_args(target)) != ALL_OK) {
+				return i;
 			}
 		}
 	}	
 	else {
-		pm0_conf.m_suspend_args = NULL;
+		target->m_suspend_args = NULL;
 	}	
 	
 
 #ifdef WITH_LIBCONFIG
 
-	if (pm0_conf.m_verbose == true) {
-		fprintf(stderr, "Processing configuration file \'%s\'.\n", pm0_conf.m_conf_file);
+	if (target->m_verbose == true) {
+		fprintf(stderr, "Processing configuration file \'%s\'.\n", target->m_conf_file);
 	}		
-	if ((config_file = fopen(pm0_conf.m_conf_file, "r")) == NULL) {
-		fprintf(stderr, "fopen() failed on \'%s\': %s\n", pm0_conf.m_conf_file, strerror(errno));
-		cleanup_main();
-		exit(ERR_FOPEN_FAIL);
+	if ((config_file = fopen(target->m_conf_file, "r")) == NULL) {
+		fprintf(stderr, "fopen() failed on \'%s\': %s\n", target->m_conf_file, strerror(errno));
+		return ERR_FOPEN_FAIL;
 	}
 	
 	if ((i = init_config(&config_parser, config_file)) != ALL_OK) {
-		cleanup_main();
-		fclose_file(config_file, pm0_conf.m_conf_file);
-		exit(i);
+		fclose_file(config_file, target->m_conf_file);
+		return i;
 	}
 	
-	if ((i = read_config(&config_parser, &pm0_conf)) != ALL_OK) {
-		cleanup_main();
-		fclose_file(config_file, pm0_conf.m_conf_file);
+	if ((i = read_config(&config_parser, target)) != ALL_OK) {
+		fclose_file(config_file, target->m_conf_file);
 		close_config(&config_parser);
-		exit(i);
+		return i;
 	}
 	
-	fclose_file(config_file, pm0_conf.m_conf_file);
+	fclose_file(config_file, target->m_conf_file);
 	close_config(&config_parser);
 	
+#else //WITH_LIBCONFIG
+
+	//without a file of key = value lines, the daemon is set up from the command line alone
+	if ((config_file = fopen(target->m_conf_file, "r")) != NULL) {
+		if (target->m_verbose == true) {
+			fprintf(stderr, "Processing configuration file \'%s\'.\n", target->m_conf_file);
+		}
+		i = read_flat_config(config_file, target);
+		fclose_file(config_file, target->m_conf_file);
+		if (i != ALL_OK) return i;
+	}
+	else if (errno != ENOENT) {
+		fprintf(stderr, "fopen() failed on \'%s\': %s\n", target->m_conf_file, strerror(errno));
+		return ERR_FOPEN_FAIL;
+	}
+	
 #endif //WITH_LIBCONFIG
 	
+	if (target->m_backend == NULL) target->m_backend = find_backend(DEFAULT_BACKEND);
+	
+	if ((i = adopt_suspend_exec(target)) != ALL_OK) return i;
+	if (target->m_verbose == true) {
+		fprintf(stderr, "The configuration takes %lu of the %lu bytes set aside for it.\n", (unsigned long) arena_used(target), (unsigned long) size);
+	}
+	return ALL_OK;
+}
+
+int main(int argc, char **argv, char **env) {
+	pid_t c_pid;//child-pid
+	struct stat buf;
+	int i;
+	
+	saved_argc = argc;
+	saved_argv = argv;
+	if ((i = load_conf(&pm0_conf, argc, argv)) != ALL_OK) {
+		cleanup_main();
+		exit(i);
+	}
+	
 	if (pm0_conf.m_timeout == 0) {
 		fprintf(stderr, "Setting the timeout argument is mandatory!\n");
 		help(stderr, EXEC_NAME);
@@ -730,10 +5750,12 @@ int main(int argc, char **argv, char **env) {
 	}
 	
 	if (stat(PID_FILE, &buf) == 0) {
-		fprintf(stderr, "%s seems to be already running! If not, then \'%s\' needs to be deleted!\n", EXEC_NAME, PID_FILE);
-		
-		cleanup_main();
-		exit(ERR_ALREADY_RUNNING);
+		if (stale_pid_file() == false) {
+			fprintf(stderr, "%s seems to be already running! If not, then \'%s\' needs to be deleted!\n", EXEC_NAME, PID_FILE);
+			
+			cleanup_main();
+			exit(ERR_ALREADY_RUNNING);
+		}
 	}
 	else {
 		if (errno != ENOENT) {
@@ -0,0 +1,89 @@
+/******************************************************************************\
+**                                                                            **
+**  pm0 - a D-Link DNS-313 HDD power management utility                       **
+**                                                                            **
+**  Copyright Janos Szigetvari <jszigetvari_(at)_gmail_(dot)_com>, 2012.      **
+**                                                                            **
+**  This program is free software: you can redistribute it and/or modify      **
+**  it under the terms of the GNU General Public License as published by      **
+**  the Free Software Foundation, either version 3 of the License, or         **
+**  (at your option) any later version.                                       **
+**                                                                            **
+**  This program is distributed in the hope that it will be useful,           **
+**  but WITHOUT ANY WARRANTY without even the implied warranty of             **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             **
+**  GNU General Public License for more details.                              **
+**                                                                            **
+**  You should have received a copy of the GNU General Public License         **
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.     **
+**                                                                            **
+**                                                                            **
+\******************************************************************************/    
+
+/*
+Definitions shared by the pm0 daemon and the pm0ctl client.
+*/
+
+#ifndef PM0_H
+#define PM0_H
+
+#include <stdint.h>
+
+//=========== CONTROL SOCKET ==========
+
+/*
+pm0ctl sends one command line, the daemon answers with any number of lines and
+closes the connection. A reply starting with "ERR" means the command has failed.
+*/
+
+#define CTL_SOCKET			"/var/run/pm0.sock"
+#define CTL_LINE_LENGTH		256
+#define CTL_REPLY_LENGTH	4096	//all replies but the metrics, which can be longer
+
+#define CTL_OK				"OK"
+#define CTL_ERR				"ERR"
+
+//=========== EVENT JOURNAL ==========
+
+/*
+The daemon keeps a history of its events in a ring of fixed-size records, in a file
+on tmpfs that it has mapped into its memory. Record n (counting from 1) is in slot
+(n - 1) % m_records. m_seq is cleared before a record is overwritten, and set once it
+is complete, so a reader that finds it unchanged after copying the record has a
+consistent copy. The file is read by "pm0ctl journal".
+*/
+
+#define JOURNAL_FILE		"/run/pm0.journal"
+#define JOURNAL_MAGIC		0x6a306d70	//"pm0j"
+#define JOURNAL_VERSION		1
+
+//event types
+#define JOURNAL_STANDBY		1	//a drive has gone to standby
+#define JOURNAL_SPINUP		2	//a drive has done I/O again, m_duration_ms is the time it was in standby
+#define JOURNAL_TRIGGER		3	//pm0ctl trigger
+#define JOURNAL_HOOK_START	4
+#define JOURNAL_HOOK_EXIT	5	//m_status and m_duration_ms are set
+#define JOURNAL_HOOK_FAIL	6	//a hook could not be started
+
+typedef struct journal_head {
+		uint32_t m_magic;
+		uint16_t m_version;
+		uint16_t m_record_size;
+		uint32_t m_records;
+		uint32_t m_pid;
+		uint64_t m_written;
+} journal_head_t;
+
+typedef struct journal_rec {
+		uint64_t m_seq;
+		uint64_t m_mono_ns;			//CLOCK_MONOTONIC
+		int64_t m_time;				//seconds since the Epoch
+		int32_t m_pid;				//of the hook
+		int32_t m_status;			//exit code of the hook, or minus the signal that has killed it
+		uint32_t m_duration_ms;
+		uint16_t m_drives;			//one bit per drive
+		uint8_t m_type;
+		uint8_t m_reserved;
+} journal_rec_t;
+
+#endif //PM0_H
@@ -0,0 +1,80 @@
+/******************************************************************************\
+**                                                                            **
+**  pm0 - a D-Link DNS-313 HDD power management utility                       **
+**                                                                            **
+**  Copyright Janos Szigetvari <jszigetvari_(at)_gmail_(dot)_com>, 2012.      **
+**                                                                            **
+**  This program is free software: you can redistribute it and/or modify      **
+**  it under the terms of the GNU General Public License as published by      **
+**  the Free Software Foundation, either version 3 of the License, or         **
+**  (at your option) any later version.                                       **
+**                                                                            **
+**  This program is distributed in the hope that it will be useful,           **
+**  but WITHOUT ANY WARRANTY without even the implied warranty of             **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             **
+**  GNU General Public License for more details.                              **
+**                                                                            **
+**  You should have received a copy of the GNU General Public License         **
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.     **
+**                                                                            **
+**                                                                            **
+\******************************************************************************/
+
+/*
+The interface between the pm0 daemon and its plugins.
+
+A plugin is a shared object listed in the "plugins" section of pm0.conf. It exports a
+pm0_plugin_t named "pm0_plugin", and it is loaded (with all of its symbols resolved) and
+locked in memory when the daemon starts. m_init gets the "arg" of the plugin, and may
+open what it will need later; a non-zero return refuses the start. m_on_standby,
+m_on_trigger and m_on_resume are called straight from the event loop, instead of
+starting a hook process, so they must not block, and must not touch the file systems of
+the drives. A trigger ("pm0ctl trigger") only runs the suspend hooks, the drive may well
+be spinning, so it goes to m_on_trigger alone; m_kind tells the events apart. A callback
+that does not return within the "timeout" of the plugin is not interrupted, but once it
+returns, the plugin is disabled: only its m_shutdown is called after that. One still
+running after twice its timeout is taken to be stuck, and the daemon aborts, removing
+its PID file, control socket and staged hooks first, so that it can be started again
+right away. So a callback should not do anything that may wait, logging included
+(syslog() can block on /dev/log). m_shutdown is called when the daemon exits. Any of the
+callbacks may be NULL.
+*/
+
+#ifndef PM0_PLUGIN_H
+#define PM0_PLUGIN_H
+
+#include <stdint.h>
+
+#define PM0_PLUGIN_ABI		2
+#define PM0_PLUGIN_SYMBOL	"pm0_plugin"
+
+#define PM0_EVENT_STANDBY	0		//the kinds of pm0_event_t
+#define PM0_EVENT_TRIGGER	1
+#define PM0_EVENT_RESUME	2
+
+typedef struct pm0_drive_info {
+		char const *m_dev;			//block device, e.g. "sda"
+		uint64_t m_standby_ms;		//in standby so far, or the last standby on resume
+		uint64_t m_spinup_ms;		//time the spin-up took, on resume
+} pm0_drive_info_t;
+
+typedef struct pm0_event {
+		char const *m_event;		//"standby", "trigger" or "resume"
+		int m_kind;					//PM0_EVENT_*, the same as m_event
+		uint32_t m_drives;			//one bit per drive the event is for
+		int64_t m_time;				//seconds since the Epoch
+		int m_drive_count;
+		pm0_drive_info_t const *m_info;	//indexed by drive ID, m_drive_count of them
+} pm0_event_t;
+
+typedef struct pm0_plugin {
+		uint32_t m_abi;				//PM0_PLUGIN_ABI
+		char const *m_name;
+		int (*m_init)(char const *);
+		void (*m_on_standby)(pm0_event_t const *);
+		void (*m_on_resume)(pm0_event_t const *);
+		void (*m_shutdown)(void);
+		void (*m_on_trigger)(pm0_event_t const *);
+} pm0_plugin_t;
+
+#endif //PM0_PLUGIN_H
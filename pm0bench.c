@@ -0,0 +1,628 @@
+/******************************************************************************\
+**                                                                            **
+**  pm0bench - benchmarks of the pm0 power management daemon                  **
+**                                                                            **
+**  Copyright Janos Szigetvari <jszigetvari_(at)_gmail_(dot)_com>, 2012.      **
+**                                                                            **
+**  This program is free software: you can redistribute it and/or modify      **
+**  it under the terms of the GNU General Public License as published by      **
+**  the Free Software Foundation, either version 3 of the License, or         **
+**  (at your option) any later version.                                       **
+**                                                                            **
+**  This program is distributed in the hope that it will be useful,           **
+**  but WITHOUT ANY WARRANTY without even the implied warranty of             **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             **
+**  GNU General Public License for more details.                              **
+**                                                                            **
+**  You should have received a copy of the GNU General Public License         **
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.     **
+**                                                                            **
+**                                                                            **
+\******************************************************************************/
+
+/*
+Starts the daemon with the "sim" backend, its timers switched off, and stands in for
+the sl_pwr driver by sending it SIGUSR1/SIGUSR2 itself. The hook it is given is this
+very program, which only reports the time it was started at through a FIFO. Measured:
+	- cold start: from exec() of the daemon until its control socket accepts connections
+	- signal to exec: from kill() until the hook runs, one event at a time
+	- hook launches: hooks started per second, while both drives are kept busy
+	- RSS: resident and peak memory of the daemon after all that, which can be held
+	  against a ceiling (--max-rss), e.g. for the "tiny" build
+With --trace, the daemon is started once, in strict mode, under "strace -f -e trace=%file",
+and the benchmark fails if the daemon makes any path syscall between the moment its
+control socket answers and the last standby event it is sent (the hooks, which run in
+processes of their own, may do as they like).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef _GNU_SOURCE
+#include <getopt.h> /* getopt_long */
+#endif
+
+#include "pm0.h"
+
+//=========== DEFINES ==========
+
+#define EXEC_NAME	"pm0bench"
+#define HOOK_ARG	"--hook"	//argv[1] of the hook run by the daemon
+#define DAEMON		"./pm0"
+#define PID_FILE	"/var/run/pm0.pid"
+#define WORK_DIR	"/tmp/pm0bench.XXXXXX"
+#define TRACE_DIR	"/dev/shm/pm0bench.XXXXXX"	//strict mode wants the journal on tmpfs
+#define STRACE		"strace"
+
+#define EVENTS			1000	//events timed one by one
+#define STARTS			5		//cold starts timed
+#define BURST_LENGTH	2000	//milliseconds of back-to-back events
+#define READY_TIMEOUT	5000	//milliseconds the daemon may take to start or stop
+#define HOOK_TIMEOUT	1000	//milliseconds to wait for a hook before calling the event lost
+
+#define ALL_OK						0
+#define ERR_INVALID_ARG				254
+#define ERR_SETUP_FAIL				253
+#define ERR_START_FAIL				252
+#define ERR_STOP_FAIL				251
+#define ERR_OUT_OF_MEMORY			250
+#define ERR_RSS_CEILING				249
+#define ERR_TRACE_FAIL				248
+
+//=========== TYPEDEFS ==========
+
+typedef enum { false=0, true=1 } bool;
+
+//what a hook sends back: the drives it was run for, and when it started
+typedef struct report {
+		struct timespec m_started;
+		char m_drives[8];
+} report_t;
+
+//=========== GLOBALS ==========
+
+char work_dir[PATH_MAX] = WORK_DIR;
+char conf_path[PATH_MAX];
+char fifo_path[PATH_MAX];
+char socket_path[PATH_MAX];
+char journal_path[PATH_MAX];
+char metrics_path[PATH_MAX];
+char trace_path[PATH_MAX];
+char const *daemon_path = DAEMON;
+char const *pid_path = PID_FILE;
+int fifo_fd = -1;
+bool trace = false;
+
+//=========== FUNCTION DECLARATIONS ==========
+
+void help(FILE *, char const * const);
+int run_hook(char const *, char const *);
+long elapsed_us(struct timespec const *, struct timespec const *);
+int compare_long(void const *, void const *);
+int write_conf(void);
+pid_t start_daemon(long *);
+int stop_daemon(pid_t);
+bool ping_daemon(void);
+bool wait_report(report_t *, int);
+int bench_latency(pid_t, unsigned long);
+int bench_launches(pid_t);
+int report_rss(pid_t, unsigned long);
+int check_trace(pid_t, struct timespec const *, struct timespec const *);
+void cleanup(void);
+
+//=========== FUNCTIONS ==========
+
+void help(FILE *fd, char const * const en) {
+    fprintf( fd,
+#ifdef _GNU_SOURCE
+	     "Usage: %s [-d|--daemon path] [-p|--pidfile path] [-n|--events count] [-s|--starts count] [-m|--max-rss kB] [-t|--trace] [-h|--help]\n"
+	     "Options:\t-d|--daemon:\t\t\tThe pm0 binary to measure (default: " DAEMON ")\n"
+	     "\t\t-p|--pidfile:\t\t\tThe PID file it was built with (default: " PID_FILE ")\n"
+	     "\t\t-n|--events:\t\t\tStandby events to time one by one\n"
+	     "\t\t-s|--starts:\t\t\tCold starts to time\n"
+	     "\t\t-m|--max-rss:\t\t\tFail if the daemon ends up with a larger RSS (in kB)\n"
+	     "\t\t-t|--trace:\t\t\tRun the daemon in strict mode under strace, fail on any path syscall after startup\n"
+		 "\t\t-h|--help:\t\t\tShow this screen\n"
+#else /* not _GNU_SOURCE */
+	     "Usage: %s [-d path] [-p path] [-n count] [-s count] [-m kB] [-t] [-h]\n"
+	     "Options:\t-d:\t\t\tThe pm0 binary to measure (default: " DAEMON ")\n"
+	     "\t\t-p:\t\t\tThe PID file it was built with (default: " PID_FILE ")\n"
+	     "\t\t-n:\t\t\tStandby events to time one by one\n"
+	     "\t\t-s:\t\t\tCold starts to time\n"
+	     "\t\t-m:\t\t\tFail if the daemon ends up with a larger RSS (in kB)\n"
+	     "\t\t-t:\t\t\tRun the daemon in strict mode under strace, fail on any path syscall after startup\n"
+		 "\t\t-h:\t\t\tShow this screen\n"
+#endif /* _GNU_SOURCE */
+	     "\n",
+	     en
+            );
+}
+
+//the daemon runs us as its hook: tell the benchmark when, as the very first thing
+int run_hook(char const *fifo, char const *drives) {
+	report_t r;
+	int fd;
+
+	clock_gettime(CLOCK_MONOTONIC, &r.m_started);
+	memset(r.m_drives, 0, sizeof(r.m_drives));
+	strncpy(r.m_drives, drives, sizeof(r.m_drives) - 1);
+
+	if ((fd = open(fifo, O_WRONLY | O_NONBLOCK)) == -1) return ERR_SETUP_FAIL;
+	//less than PIPE_BUF, so the reports of concurrent hooks don't mix
+	if (write(fd, &r, sizeof(r)) != sizeof(r)) {
+		close(fd);
+		return ERR_SETUP_FAIL;
+	}
+	close(fd);
+	return ALL_OK;
+}
+
+long elapsed_us(struct timespec const *from, struct timespec const *to) {
+	return (to->tv_sec - from->tv_sec) * 1000000L + (to->tv_nsec - from->tv_nsec) / 1000L;
+}
+
+int compare_long(void const *a, void const *b) {
+	long x = *(long const *) a, y = *(long const *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+Both sim timers are off, so every standby event is one of ours. Each hook run is
+timed, the cooldown and the coalescing window would hide most of them. A traced
+daemon runs in strict mode, which stages the hook (this program) to tmpfs, and
+verbose, with a metrics file, so that their work after startup is traced as well.
+*/
+int write_conf(void) {
+	char self[PATH_MAX], traced[PATH_MAX + 64] = "";
+	ssize_t len;
+	FILE *conf;
+
+	if ((len = readlink("/proc/self/exe", self, PATH_MAX - 1)) == -1) {
+		fprintf(stderr, "readlink() failed on \'/proc/self/exe\': %s\n", strerror(errno));
+		return ERR_SETUP_FAIL;
+	}
+	self[len] = '\0';
+	if (trace == true) snprintf(traced, sizeof(traced), "\tstrict = true;\n\tverbose = true;\n\tmetrics_file = \"%s\";\n", metrics_path);
+
+	if ((conf = fopen(conf_path, "w")) == NULL) {
+		fprintf(stderr, "fopen() failed on \'%s\': %s\n", conf_path, strerror(errno));
+		return ERR_SETUP_FAIL;
+	}
+	fprintf(conf,
+		"main:\n{\n"
+		"\tbackend = \"sim\";\n"
+		"\tsuspend_timeout = 10;\n"
+		"\tdrives = [ \"pm0bench0\", \"pm0bench1\" ];\n"
+		"\tlog_buffer = 0;\n"
+		"\tcoalesce_window = 0;\n"
+		"\thook_cooldown = 0;\n"
+		"\tcontrol_socket = \"%s\";\n"
+		"\tjournal_file = \"%s\";\n"
+		"%s"
+		"};\n"
+		"simulator:\n{\n\tinterval = [ 0, 0 ];\n};\n"
+		"hooks =\n(\n"
+		"\t{ exec = \"%s\"; args = [ \"" HOOK_ARG "\", \"%s\", \"%%d\" ]; max_running = 16; timeout = 10; }\n"
+		");\n",
+		socket_path, journal_path, traced, self, fifo_path);
+	if (fclose(conf) == EOF) {
+		fprintf(stderr, "fclose() failed on \'%s\': %s\n", conf_path, strerror(errno));
+		return ERR_SETUP_FAIL;
+	}
+	return ALL_OK;
+}
+
+//starts the daemon, and waits for its control socket to answer; *us is how long that took
+pid_t start_daemon(long *us) {
+	struct sockaddr_un addr;
+	struct timespec t0, now;
+	char pid_buf[16] = {0};
+	pid_t c_pid, d_pid = 0;
+	int status, fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	//WORK_DIR keeps it well within sun_path
+	strcpy(addr.sun_path, socket_path);
+
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if ((c_pid = fork()) == -1) {
+		fprintf(stderr, "fork() failed: %s\n", strerror(errno));
+		return -1;
+	}
+	if (c_pid == 0) {
+		//the daemon closes them anyway, and "Starting pm0 daemon" is of no interest
+		freopen("/dev/null", "w", stdout);
+		//-D leaves the daemon our child, with strace detached from both of us
+		if (trace == true) execlp(STRACE, STRACE, "-D", "-f", "-ttt", "-e", "trace=%file", "-e", "signal=none", "-o", trace_path,
+			daemon_path, "--config", conf_path, (char *) NULL);
+		else execl(daemon_path, daemon_path, "--config", conf_path, (char *) NULL);
+		_exit(127);
+	}
+	if ((waitpid(c_pid, &status, 0) == -1) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+		fprintf(stderr, "\'%s\' has failed to start (exit code %d), see the syslog.\n", daemon_path, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+		return -1;
+	}
+
+	while (true) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (elapsed_us(&t0, &now) > READY_TIMEOUT * 1000L) {
+			fprintf(stderr, "\'%s\' has not opened \'%s\' in %d ms.\n", daemon_path, socket_path, READY_TIMEOUT);
+			return -1;
+		}
+		if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+			fprintf(stderr, "socket() failed: %s\n", strerror(errno));
+			return -1;
+		}
+		if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+			close(fd);
+			break;
+		}
+		close(fd);
+		usleep(100);
+	}
+	*us = elapsed_us(&t0, &now);
+
+	if ((fd = open(pid_path, O_RDONLY)) != -1) {
+		if (read(fd, pid_buf, sizeof(pid_buf) - 1) > 0) d_pid = (pid_t) strtol(pid_buf, NULL, 10);
+		close(fd);
+	}
+	if (d_pid <= 0) {
+		fprintf(stderr, "No PID in \'%s\', is it the one \'%s\' was built with?\n", pid_path, daemon_path);
+		return -1;
+	}
+	return d_pid;
+}
+
+//the daemon is not our child, so we can only watch its PID file go away
+int stop_daemon(pid_t d_pid) {
+	struct stat buf;
+	int i;
+
+	if (kill(d_pid, SIGTERM) == -1) {
+		fprintf(stderr, "kill() failed on PID %ld: %s\n", (long) d_pid, strerror(errno));
+		return ERR_STOP_FAIL;
+	}
+	for (i=0; i<READY_TIMEOUT; i++) {
+		if ((kill(d_pid, 0) == -1) && (stat(pid_path, &buf) == -1)) return ALL_OK;
+		usleep(1000);
+	}
+	fprintf(stderr, "PID %ld has not exited in %d ms.\n", (long) d_pid, READY_TIMEOUT);
+	return ERR_STOP_FAIL;
+}
+
+//a reply to "status" means the daemon is done starting up, and waits in its event loop
+bool ping_daemon(void) {
+	struct sockaddr_un addr;
+	char reply[CTL_REPLY_LENGTH];
+	bool ok = false;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		fprintf(stderr, "socket() failed: %s\n", strerror(errno));
+		return false;
+	}
+	if ((connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) && (write(fd, "status\n", 7) == 7)) {
+		ok = (read(fd, reply, sizeof(reply)) > 0) ? true : false;
+	}
+	close(fd);
+	if (ok == false) fprintf(stderr, "\'%s\' has not answered on \'%s\'.\n", daemon_path, socket_path);
+	return ok;
+}
+
+bool wait_report(report_t *r, int ms) {
+	struct pollfd pfd = { fifo_fd, POLLIN, 0 };
+
+	if (poll(&pfd, 1, ms) < 1) return false;
+	return (read(fifo_fd, r, sizeof(report_t)) == sizeof(report_t)) ? true : false;
+}
+
+//one event at a time, alternating between the drives, from kill() to the start of the hook
+int bench_latency(pid_t d_pid, unsigned long events) {
+	struct timespec sent;
+	unsigned long i, n = 0, lost = 0;
+	report_t r;
+	long *us;
+
+	if ((us = (long *) calloc(events, sizeof(long))) == NULL) {
+		fprintf(stderr, "calloc() failed!\n");
+		return ERR_OUT_OF_MEMORY;
+	}
+
+	for (i=0; i<events; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &sent);
+		kill(d_pid, ((i % 2) == 0) ? SIGUSR2 : SIGUSR1);
+		if (wait_report(&r, HOOK_TIMEOUT) == false) {
+			lost++;
+			continue;
+		}
+		us[n++] = elapsed_us(&sent, &r.m_started);
+	}
+
+	if (n == 0) {
+		fprintf(stderr, "No hook has reported back, see the syslog.\n");
+		free(us);
+		return ERR_START_FAIL;
+	}
+	qsort(us, n, sizeof(long), compare_long);
+	printf("signal to exec:   p50 %ld us, p99 %ld us, p999 %ld us, max %ld us (%lu events, %lu lost)\n",
+		us[(n - 1) * 50 / 100], us[(n - 1) * 99 / 100], us[(n - 1) * 999 / 1000], us[n - 1], n, lost);
+	free(us);
+	return ALL_OK;
+}
+
+/*
+Both drives are kept busy: the next event of a drive is sent as soon as its hook has
+started. Pending signals of the same kind merge, so there is no point in sending more.
+*/
+int bench_launches(pid_t d_pid) {
+	struct timespec t0, now;
+	unsigned long launches = 0, stalls = 0;
+	report_t r;
+	long us;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	kill(d_pid, SIGUSR2);
+	kill(d_pid, SIGUSR1);
+
+	do {
+		if (wait_report(&r, HOOK_TIMEOUT / 10) == true) {
+			launches++;
+			kill(d_pid, (r.m_drives[0] == '0') ? SIGUSR2 : SIGUSR1);
+		}
+		else {
+			//the daemon may have been out of hook slots
+			stalls++;
+			kill(d_pid, SIGUSR2);
+			kill(d_pid, SIGUSR1);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while ((us = elapsed_us(&t0, &now)) < BURST_LENGTH * 1000L);
+
+	//let the last ones finish, so they don't count towards the RSS
+	while (wait_report(&r, HOOK_TIMEOUT / 10) == true);
+
+	printf("hook launches:    %.1f per second (%lu in %ld ms, %lu stall(s))\n", launches * 1000000.0 / us, launches, us / 1000, stalls);
+	return ALL_OK;
+}
+
+//the RSS is checked against max_rss kB, unless it is 0
+int report_rss(pid_t d_pid, unsigned long max_rss) {
+	char path[64], line[128];
+	unsigned long rss = 0, hwm = 0;
+	FILE *status;
+
+	snprintf(path, sizeof(path), "/proc/%ld/status", (long) d_pid);
+	if ((status = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "fopen() failed on \'%s\': %s\n", path, strerror(errno));
+		return (max_rss > 0) ? ERR_RSS_CEILING : ALL_OK;
+	}
+	while (fgets(line, sizeof(line), status) != NULL) {
+		if (sscanf(line, "VmRSS: %lu kB", &rss) == 1) continue;
+		sscanf(line, "VmHWM: %lu kB", &hwm);
+	}
+	fclose(status);
+	printf("daemon RSS:       %lu kB (peak %lu kB)\n", rss, hwm);
+	if ((max_rss > 0) && (hwm > max_rss)) {
+		fprintf(stderr, "The peak RSS of the daemon is over the ceiling of %lu kB!\n", max_rss);
+		return ERR_RSS_CEILING;
+	}
+	return ALL_OK;
+}
+
+/*
+The path syscalls of the daemon itself (told apart from its hooks by the PID) that were
+made between from and to, both CLOCK_REALTIME, as strace -ttt stamps them. The trace is
+only complete once strace has seen the daemon exit.
+*/
+int check_trace(pid_t d_pid, struct timespec const *from, struct timespec const *to) {
+	char line[512];
+	double t0 = from->tv_sec + from->tv_nsec / 1e9, t1 = to->tv_sec + to->tv_nsec / 1e9, t;
+	unsigned long calls = 0, lines = 0;
+	bool done = false;
+	long pid;
+	FILE *log;
+	int i, n;
+
+	for (i=0; (i<READY_TIMEOUT) && (done == false); i++) {
+		if ((log = fopen(trace_path, "r")) == NULL) {
+			fprintf(stderr, "fopen() failed on \'%s\': %s\n", trace_path, strerror(errno));
+			return ERR_TRACE_FAIL;
+		}
+		while ((done == false) && (fgets(line, sizeof(line), log) != NULL)) {
+			if ((sscanf(line, "%ld %lf %n", &pid, &t, &n) == 2) && (pid == (long) d_pid) && (strncmp(line + n, "+++", 3) == 0)) done = true;
+		}
+		fclose(log);
+		if (done == false) usleep(1000);
+	}
+	if (done == false) {
+		fprintf(stderr, "strace has not seen PID %ld exit in %d ms, is it installed?\n", (long) d_pid, READY_TIMEOUT);
+		return ERR_TRACE_FAIL;
+	}
+
+	if ((log = fopen(trace_path, "r")) == NULL) {
+		fprintf(stderr, "fopen() failed on \'%s\': %s\n", trace_path, strerror(errno));
+		return ERR_TRACE_FAIL;
+	}
+	while (fgets(line, sizeof(line), log) != NULL) {
+		lines++;
+		if ((sscanf(line, "%ld %lf %n", &pid, &t, &n) != 2) || (pid != (long) d_pid)) continue;
+		if ((t < t0) || (t > t1) || (strncmp(line + n, "+++", 3) == 0)) continue;
+		if (calls++ == 0) fprintf(stderr, "Path syscalls of the daemon after startup:\n");
+		fprintf(stderr, "\t%s", line + n);
+	}
+	fclose(log);
+	printf("strict trace:     %lu path syscall(s) after startup (%lu traced in all)\n", calls, lines);
+	return (calls == 0) ? ALL_OK : ERR_TRACE_FAIL;
+}
+
+void cleanup(void) {
+	if (fifo_fd != -1) close(fifo_fd);
+	unlink(fifo_path);
+	unlink(conf_path);
+	unlink(socket_path);
+	unlink(journal_path);
+	unlink(metrics_path);
+	unlink(trace_path);
+	rmdir(work_dir);
+}
+
+//=========== MAIN ==========
+
+int main(int argc, char **argv) {
+	char const *const optstr = "hd:p:n:s:m:t";
+	unsigned long events = EVENTS, starts = STARTS, max_rss = 0, i;
+	struct timespec ready, last;
+	long *start_us;
+	pid_t d_pid = -1;
+	int c, ret;
+
+#ifdef _GNU_SOURCE
+		static struct option long_opts[] = {
+			{"help", 0, NULL, 'h'},
+			{"daemon", 1, NULL, 'd'},
+			{"pidfile", 1, NULL, 'p'},
+			{"events", 1, NULL, 'n'},
+			{"starts", 1, NULL, 's'},
+			{"max-rss", 1, NULL, 'm'},
+			{"trace", 0, NULL, 't'},
+			{NULL, 0, NULL, 0},
+		};
+#endif
+
+	if ((argc == 4) && (strcmp(argv[1], HOOK_ARG) == 0)) return run_hook(argv[2], argv[3]);
+
+	while (1) {
+#ifdef _GNU_SOURCE
+		c = getopt_long(argc, argv, optstr, long_opts, NULL);
+#else /* not _GNU_SOURCE */
+		c = getopt(argc, argv, optstr);
+#endif /* _GNU_SOURCE */
+		if (c == -1) break;
+
+		switch (c) {
+			case 'h':
+				help(stdout, EXEC_NAME);
+				exit(ALL_OK);
+				break;
+			case 'd':
+				daemon_path = optarg;
+				break;
+			case 'p':
+				pid_path = optarg;
+				break;
+			case 'n':
+				events = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				starts = strtoul(optarg, NULL, 10);
+				break;
+			case 'm':
+				max_rss = strtoul(optarg, NULL, 10);
+				break;
+			case 't':
+				trace = true;
+				break;
+			case '?':
+			default:
+				help(stderr, EXEC_NAME);
+				exit(ERR_INVALID_ARG);
+		}
+	}
+	if ((events == 0) || (starts == 0)) {
+		help(stderr, EXEC_NAME);
+		exit(ERR_INVALID_ARG);
+	}
+
+	if (trace == true) strcpy(work_dir, TRACE_DIR);
+	if (mkdtemp(work_dir) == NULL) {
+		fprintf(stderr, "mkdtemp() failed on \'%s\': %s\n", (trace == true) ? TRACE_DIR : WORK_DIR, strerror(errno));
+		exit(ERR_SETUP_FAIL);
+	}
+	snprintf(conf_path, PATH_MAX, "%s/pm0.conf", work_dir);
+	snprintf(fifo_path, PATH_MAX, "%s/hook.fifo", work_dir);
+	snprintf(socket_path, PATH_MAX, "%s/pm0.sock", work_dir);
+	snprintf(journal_path, PATH_MAX, "%s/pm0.journal", work_dir);
+	snprintf(metrics_path, PATH_MAX, "%s/pm0.prom", work_dir);
+	snprintf(trace_path, PATH_MAX, "%s/strace.log", work_dir);
+	//a single start, the trace is about what follows it
+	if (trace == true) starts = 1;
+
+	//opened for writing too, so that it never reads EOF between two hooks
+	if ((mkfifo(fifo_path, S_IRUSR | S_IWUSR) == -1) || ((fifo_fd = open(fifo_path, O_RDWR | O_NONBLOCK)) == -1)) {
+		fprintf(stderr, "Setting up \'%s\' failed: %s\n", fifo_path, strerror(errno));
+		cleanup();
+		exit(ERR_SETUP_FAIL);
+	}
+	if ((ret = write_conf()) != ALL_OK) {
+		cleanup();
+		exit(ret);
+	}
+	if ((start_us = (long *) calloc(starts, sizeof(long))) == NULL) {
+		fprintf(stderr, "calloc() failed!\n");
+		cleanup();
+		exit(ERR_OUT_OF_MEMORY);
+	}
+
+	printf("%s: measuring \'%s\'\n", EXEC_NAME, daemon_path);
+
+	//the last daemon started is kept for the rest of the measurements
+	for (i=0; i<starts; i++) {
+		if ((d_pid = start_daemon(&start_us[i])) == -1) {
+			free(start_us);
+			cleanup();
+			exit(ERR_START_FAIL);
+		}
+		if ((i < starts - 1) && ((ret = stop_daemon(d_pid)) != ALL_OK)) {
+			free(start_us);
+			cleanup();
+			exit(ret);
+		}
+	}
+	qsort(start_us, starts, sizeof(long), compare_long);
+	printf("cold start:       min %.2f ms, median %.2f ms, max %.2f ms (%lu starts)\n",
+		start_us[0] / 1000.0, start_us[starts / 2] / 1000.0, start_us[starts - 1] / 1000.0, starts);
+	free(start_us);
+
+	if (trace == true) {
+		if (ping_daemon() == false) {
+			stop_daemon(d_pid);
+			cleanup();
+			return ERR_START_FAIL;
+		}
+		clock_gettime(CLOCK_REALTIME, &ready);
+		ret = bench_latency(d_pid, events);
+		clock_gettime(CLOCK_REALTIME, &last);
+		if (stop_daemon(d_pid) != ALL_OK) ret = ERR_STOP_FAIL;
+		else if (check_trace(d_pid, &ready, &last) != ALL_OK) ret = ERR_TRACE_FAIL;
+		cleanup();
+		return ret;
+	}
+
+	if (((ret = bench_latency(d_pid, events)) == ALL_OK) && ((ret = bench_launches(d_pid)) == ALL_OK)) {
+		ret = report_rss(d_pid, max_rss);
+	}
+
+	if (stop_daemon(d_pid) != ALL_OK) ret = ERR_STOP_FAIL;
+	cleanup();
+	return ret;
+}
@@ -0,0 +1,297 @@
+/******************************************************************************\
+**                                                                            **
+**  pm0ctl - control client of the pm0 power management daemon              **
+**                                                                            **
+**  Copyright Janos Szigetvari <jszigetvari_(at)_gmail_(dot)_com>, 2012.      **
+**                                                                            **
+**  This program is free software: you can redistribute it and/or modify      **
+**  it under the terms of the GNU General Public License as published by      **
+**  the Free Software Foundation, either version 3 of the License, or         **
+**  (at your option) any later version.                                       **
+**                                                                            **
+**  This program is distributed in the hope that it will be useful,           **
+**  but WITHOUT ANY WARRANTY without even the implied warranty of             **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             **
+**  GNU General Public License for more details.                              **
+**                                                                            **
+**  You should have received a copy of the GNU General Public License         **
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.     **
+**                                                                            **
+**                                                                            **
+\******************************************************************************/    
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <time.h>
+
+#ifdef _GNU_SOURCE
+#include <getopt.h> /* getopt_long */
+#endif
+
+#include "pm0.h"
+
+//=========== DEFINES ==========
+
+#define EXEC_NAME	"pm0ctl"
+
+#define ALL_OK						0
+#define ERR_INVALID_ARG				254
+#define ERR_CONNECT_FAIL			253
+#define ERR_WRITE_FAIL				252
+#define ERR_READ_FAIL				251
+#define ERR_COMMAND_FAIL			250
+#define ERR_JOURNAL_FAIL			249
+
+//=========== FUNCTION DECLARATIONS ==========
+
+void help(FILE *, char const * const);
+int send_command(char const *, char const *);
+int read_journal(char const *, unsigned long);
+char const *journal_type(int);
+
+//=========== FUNCTIONS ==========
+
+void help(FILE *fd, char const * const en) {
+    fprintf( fd,
+#ifdef _GNU_SOURCE
+	     "Usage: %s [-s|--socket path] [-j|--journal path] [-h|--help] command [args]\n"
+	     "Options:\t-s|--socket:\t\t\tUse a different control socket\n"
+	     "\t\t-j|--journal:\t\t\tRead a different journal file\n"
+		 "\t\t-h|--help:\t\t\tShow this screen\n"
+#else /* not _GNU_SOURCE */ 
+	     "Usage: %s [-s path] [-j path] [-h] command [args]\n"
+	     "Options:\t-s:\t\t\tUse a different control socket\n"
+	     "\t\t-j:\t\t\tRead a different journal file\n"
+		 "\t\t-h:\t\t\tShow this screen\n"
+#endif /* _GNU_SOURCE */
+	     "Commands:\tstatus\t\t\t\tShow the timeout and the last known state of the drives\n"
+	     "\t\ttimeout <minutes>\t\tSet the HDD suspend timeout\n"
+	     "\t\ttrigger <drive>\t\t\tRun the suspend hook of a drive now\n"
+	     "\t\tpolicy\t\t\t\tShow the recent decisions of the adaptive timeout\n"
+	     "\t\tmetrics\t\t\t\tShow the counters of the daemon in Prometheus format\n"
+	     "\t\twakeups\t\t\t\tShow the processes that touched the drives before their last spin-up\n"
+	     "\t\tjournal [count]\t\t\tShow the last events of the daemon from its journal\n"
+	     "\n",
+	     en
+            );
+}
+
+//sends one command line, copies the reply to stdout, fails if the daemon said so
+int send_command(char const *path, char const *cmd) {
+	char reply[CTL_REPLY_LENGTH];
+	struct sockaddr_un addr;
+	ssize_t len, total = 0;
+	FILE *out = stdout;
+	char const *start;
+	int fd, ret = ALL_OK;
+	
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "The socket path \'%s\' is too long!\n", path);
+		return ERR_INVALID_ARG;
+	}
+	
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		fprintf(stderr, "socket() failed: %s\n", strerror(errno));
+		return ERR_CONNECT_FAIL;
+	}
+	
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "connect() failed on \'%s\': %s\n", path, strerror(errno));
+		close(fd);
+		return ERR_CONNECT_FAIL;
+	}
+	
+	if (write(fd, cmd, strlen(cmd)) == -1) {
+		fprintf(stderr, "write() failed on \'%s\': %s\n", path, strerror(errno));
+		close(fd);
+		return ERR_WRITE_FAIL;
+	}
+	
+	//the status line is in the first buffer, a longer reply (the metrics) is copied on in pieces
+	while ((total < CTL_REPLY_LENGTH - 1) && ((len = read(fd, reply + total, CTL_REPLY_LENGTH - 1 - total)) > 0)) total += len;
+	reply[total] = '\0';
+	start = reply;
+	
+	if (strncmp(reply, CTL_ERR, strlen(CTL_ERR)) == 0) {
+		out = stderr;
+		ret = ERR_COMMAND_FAIL;
+	}
+	//the status line is for us, not for the user
+	else if (strncmp(reply, CTL_OK "\n", strlen(CTL_OK) + 1) == 0) start += strlen(CTL_OK) + 1;
+	fwrite(start, 1, total - (start - reply), out);
+	
+	if (total == CTL_REPLY_LENGTH - 1) {
+		while ((len = read(fd, reply, CTL_REPLY_LENGTH)) > 0) fwrite(reply, 1, len, out);
+	}
+	close(fd);
+	if (len == -1) {
+		fprintf(stderr, "read() failed on \'%s\': %s\n", path, strerror(errno));
+		return ERR_READ_FAIL;
+	}
+	
+	return ret;
+}
+
+char const *journal_type(int type) {
+	switch (type) {
+		case JOURNAL_STANDBY:		return "standby";
+		case JOURNAL_SPINUP:		return "spinup";
+		case JOURNAL_TRIGGER:		return "trigger";
+		case JOURNAL_HOOK_START:	return "hook_start";
+		case JOURNAL_HOOK_EXIT:		return "hook_exit";
+		case JOURNAL_HOOK_FAIL:		return "hook_fail";
+		default:					return "unknown";
+	}
+}
+
+/*
+Decodes the journal straight from the file, the daemon does not have to answer for it.
+A record the daemon has overwritten while we were copying it is left out.
+*/
+int read_journal(char const *path, unsigned long count) {
+	journal_head_t const *head;
+	journal_rec_t const *recs;
+	journal_rec_t rec;
+	struct stat st;
+	struct tm tm_buf;
+	char stamp[32];
+	time_t when;
+	uint64_t written, seq, first;
+	void *map;
+	int fd, i;
+	
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		fprintf(stderr, "open() failed on \'%s\': %s\n", path, strerror(errno));
+		return ERR_JOURNAL_FAIL;
+	}
+	if ((fstat(fd, &st) == -1) || ((st.st_size >= (off_t) sizeof(journal_head_t)) &&
+		((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED))) {
+		fprintf(stderr, "Mapping \'%s\' has failed: %s\n", path, strerror(errno));
+		close(fd);
+		return ERR_JOURNAL_FAIL;
+	}
+	if (st.st_size < (off_t) sizeof(journal_head_t)) {
+		fprintf(stderr, "\'%s\' is not a journal of this version of pm0!\n", path);
+		close(fd);
+		return ERR_JOURNAL_FAIL;
+	}
+	close(fd);
+	
+	head = (journal_head_t const *) map;
+	recs = (journal_rec_t const *) (head + 1);
+	if ((head->m_magic != JOURNAL_MAGIC) || (head->m_version != JOURNAL_VERSION) || (head->m_record_size != sizeof(journal_rec_t)) ||
+		(head->m_records == 0) || ((off_t) (sizeof(journal_head_t) + (uint64_t) head->m_records * sizeof(journal_rec_t)) > st.st_size)) {
+		fprintf(stderr, "\'%s\' is not a journal of this version of pm0!\n", path);
+		munmap(map, st.st_size);
+		return ERR_JOURNAL_FAIL;
+	}
+	
+	written = head->m_written;
+	first = (written > head->m_records) ? written - head->m_records + 1 : 1;
+	if ((count > 0) && (written >= count) && (written - count + 1 > first)) first = written - count + 1;
+	
+	printf("journal of PID %lu, %llu event(s) written, %lu kept\n", (unsigned long) head->m_pid,
+		(unsigned long long) written, (unsigned long) head->m_records);
+	for (seq = first; seq <= written; seq++) {
+		rec = recs[(seq - 1) % head->m_records];
+		__sync_synchronize();
+		if ((rec.m_seq != seq) || (recs[(seq - 1) % head->m_records].m_seq != seq)) continue;
+		
+		when = (time_t) rec.m_time;
+		strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime_r(&when, &tm_buf));
+		printf("%llu %s mono=%llu.%03llu %s drives=", (unsigned long long) rec.m_seq, stamp,
+			(unsigned long long) (rec.m_mono_ns / 1000000000ULL), (unsigned long long) ((rec.m_mono_ns / 1000000ULL) % 1000),
+			journal_type(rec.m_type));
+		for (i=0; i<16; i++) {
+			if ((rec.m_drives & (1u << i)) != 0) printf(((rec.m_drives & ((1u << i) - 1)) == 0) ? "%d" : ",%d", i);
+		}
+		if (rec.m_pid != 0) printf(" pid=%ld", (long) rec.m_pid);
+		if (rec.m_type == JOURNAL_HOOK_EXIT) printf((rec.m_status < 0) ? " signal=%ld" : " status=%ld", (long) ((rec.m_status < 0) ? -rec.m_status : rec.m_status));
+		if ((rec.m_type == JOURNAL_HOOK_EXIT) || (rec.m_type == JOURNAL_SPINUP)) printf(" duration=%lums", (unsigned long) rec.m_duration_ms);
+		printf("\n");
+	}
+	
+	munmap(map, st.st_size);
+	return ALL_OK;
+}
+
+//=========== MAIN ==========
+
+int main(int argc, char **argv) {
+	char const *const optstr = "hs:j:";
+	char const *path = CTL_SOCKET;
+	char const *journal_path = JOURNAL_FILE;
+	char cmd[CTL_LINE_LENGTH] = {0};
+	size_t len = 0;
+	int c;
+	
+#ifdef _GNU_SOURCE
+		static struct option long_opts[] = {
+			{"help", 0, NULL, 'h'},
+			{"socket", 1, NULL, 's'},
+			{"journal", 1, NULL, 'j'},
+			{NULL, 0, NULL, 0},
+		};
+#endif
+	
+	while (1) {
+#ifdef _GNU_SOURCE
+		c = getopt_long(argc, argv, optstr, long_opts, NULL);
+#else /* not _GNU_SOURCE */ 
+		c = getopt(argc, argv, optstr);
+#endif /* _GNU_SOURCE */
+		if (c == -1) break;
+		
+		switch (c) {
+			case 'h':
+				help(stdout, EXEC_NAME);
+				exit(ALL_OK);
+				break;
+			case 's':
+				path = optarg;
+				break;
+			case 'j':
+				journal_path = optarg;
+				break;
+			case '?':
+			default:
+				help(stderr, EXEC_NAME);
+				exit(ERR_INVALID_ARG);
+		}
+	}
+	
+	if (optind >= argc) {
+		help(stderr, EXEC_NAME);
+		exit(ERR_INVALID_ARG);
+	}
+	
+	//the journal is read here, not by the daemon
+	if (strcmp(argv[optind], "journal") == 0) {
+		return read_journal(journal_path, (optind + 1 < argc) ? strtoul(argv[optind + 1], NULL, 10) : 0);
+	}
+	
+	//the command and its arguments travel as one line
+	for (; optind < argc; optind++) {
+		len += snprintf(cmd + len, CTL_LINE_LENGTH - len, (len == 0) ? "%s" : " %s", argv[optind]);
+		if (len >= CTL_LINE_LENGTH - 1) {
+			fprintf(stderr, "The command is too long!\n");
+			exit(ERR_INVALID_ARG);
+		}
+	}
+	cmd[len++] = '\n';
+	
+	return send_command(path, cmd);
+}
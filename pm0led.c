@@ -0,0 +1,83 @@
+/******************************************************************************\
+**                                                                            **
+**  pm0led - a pm0 plugin that shows whether the drives are spinning on an LED **
+**                                                                            **
+**  Copyright Janos Szigetvari <jszigetvari_(at)_gmail_(dot)_com>, 2012.      **
+**                                                                            **
+**  This program is free software: you can redistribute it and/or modify      **
+**  it under the terms of the GNU General Public License as published by      **
+**  the Free Software Foundation, either version 3 of the License, or         **
+**  (at your option) any later version.                                       **
+**                                                                            **
+**  This program is distributed in the hope that it will be useful,           **
+**  but WITHOUT ANY WARRANTY without even the implied warranty of             **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             **
+**  GNU General Public License for more details.                              **
+**                                                                            **
+**  You should have received a copy of the GNU General Public License         **
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.     **
+**                                                                            **
+**                                                                            **
+\******************************************************************************/
+
+/*
+The "arg" of the plugin is the brightness file of an LED, e.g.
+"/sys/class/leds/dns313:blue:power/brightness". The LED is switched off while any of
+the drives of the plugin is in standby, and on again once they have all resumed. A
+trigger puts no drive to sleep, so the plugin has no m_on_trigger. The file is opened
+by init, so a callback is a single write() to sysfs. Only init logs, a failed write
+from a callback is let go: the LED is set again on the next event.
+*/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+
+#include "pm0_plugin.h"
+
+//=========== GLOBALS ==========
+
+int led_fd = -1;
+//drives in standby, one bit each
+uint32_t led_asleep = 0;
+
+//=========== FUNCTIONS ==========
+
+bool led_set(char const *value) {
+	return (pwrite(led_fd, value, strlen(value), 0) == -1) ? false : true;
+}
+
+int led_init(char const *arg) {
+	if ((led_fd = open(arg, O_WRONLY | O_CLOEXEC)) == -1) {
+		syslog(LOG_ERR, "pm0led: open() failed on \'%s\': %s\n", arg, strerror(errno));
+		return -1;
+	}
+	if (led_set("1") == false) {
+		syslog(LOG_ERR, "pm0led: write() failed on \'%s\': %s\n", arg, strerror(errno));
+		close(led_fd);
+		led_fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+void led_on_standby(pm0_event_t const *ev) {
+	led_asleep |= ev->m_drives;
+	led_set("0");
+}
+
+void led_on_resume(pm0_event_t const *ev) {
+	led_asleep &= ~ev->m_drives;
+	if (led_asleep == 0) led_set("1");
+}
+
+void led_shutdown(void) {
+	led_set("1");
+	close(led_fd);
+	led_fd = -1;
+}
+
+pm0_plugin_t const pm0_plugin = { PM0_PLUGIN_ABI, "pm0led", led_init, led_on_standby, led_on_resume, led_shutdown, NULL };